@@ -0,0 +1,61 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <iostream>
+
+#include "detector.h"
+#include "utils.h"
+
+
+struct CascadeConfig
+{
+    // frames whose top confidence of the small model falls in [lowConf, highConf) are escalated
+    float lowConf{0.3f};
+    float highConf{0.6f};
+    // frames with a small model detection overlapping one of these regions are escalated
+    std::vector<cv::Rect> rois;
+    // minimum IOU of the top detections of both models to count as agreement
+    float agreementIoU{0.5f};
+};
+
+struct CascadeStats
+{
+    size_t frames{};
+    size_t escalations{};
+    size_t agreements{};     // escalated frames whose top detection matches the small model
+    double smallTimeMs{};    // total time spent in the small model
+    double largeTimeMs{};    // total time spent in the large model
+
+    double escalationRate() const { return frames ? (double)escalations / (double)frames : 0.0; }
+    double agreementRate() const { return escalations ? (double)agreements / (double)escalations : 0.0; }
+    double meanLatencyMs() const { return frames ? (smallTimeMs + largeTimeMs) / (double)frames : 0.0; }
+};
+
+class CascadeDetector
+{
+public:
+    CascadeDetector(const std::string& smallModelPath,
+                    const std::string& largeModelPath,
+                    const bool& isGPU,
+                    const cv::Size& smallInputSize,
+                    const cv::Size& largeInputSize,
+                    const CascadeConfig& config);
+
+    std::vector<Detection> detect(cv::Mat &image, const float& confThreshold, const float& iouThreshold);
+
+    const CascadeStats& getStats() const { return stats; }
+    void resetStats() { stats = CascadeStats(); }
+    void printStats(std::ostream& os) const;
+
+    YOLODetector& smallDetector() { return small; }
+    YOLODetector& largeDetector() { return large; }
+
+private:
+    YOLODetector small{nullptr};
+    YOLODetector large{nullptr};
+    CascadeConfig config;
+    CascadeStats stats;
+
+    bool needsEscalation(const std::vector<Detection>& detections, const float& topConf) const;
+    static const Detection* topDetection(const std::vector<Detection>& detections);
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <iostream>
+
+#include "detector.h"
+#include "utils.h"
+
+
+struct DeadlineLevel
+{
+    std::string modelPath;
+    cv::Size inputSize;   // sizes other than the export size need a dynamic-shape model
+};
+
+struct DeadlinePolicy
+{
+    int missesBeforeFallback{3};   // consecutive misses before falling back one level
+    int hitsBeforeRecovery{300};   // consecutive frames with headroom before going back up one level
+    float recoveryHeadroom{0.7f};  // a frame counts toward recovery below this fraction of the budget
+};
+
+struct DeadlineStats
+{
+    size_t frames{};
+    size_t misses{};       // frames abandoned at the deadline or finished late
+    size_t cancelled{};    // misses abandoned before the result was ready
+    size_t fallbacks{};
+    size_t recoveries{};
+    std::vector<size_t> levelFrames; // frames run at each level
+
+    double missRate() const { return frames ? (double)misses / (double)frames : 0.0; }
+};
+
+/**
+ * @brief Runs detections within a per-frame budget, degrading to lighter levels when it is missed
+ * 
+ * Levels go from the most accurate to the cheapest, e.g. the full model at 640,
+ * the same model at 320 and a nano model. All of them are prewarmed on construction.
+ * Levels of one dynamic-shape model differ only by input size and share its session.
+ */
+class DeadlineDetector
+{
+public:
+    DeadlineDetector(const std::vector<DeadlineLevel>& levels,
+                     const bool& isGPU,
+                     const cv::Size& frameSize,
+                     const DeadlinePolicy& policy);
+
+    std::vector<Detection> detect(cv::Mat &image, const std::chrono::microseconds& budget,
+                                  const float& confThreshold, const float& iouThreshold);
+
+    bool lastFrameMissed() const { return lastMissed; }
+    size_t getLevel() const { return level; }
+
+    const DeadlineStats& getStats() const { return stats; }
+    void resetStats();
+    void printStats(std::ostream& os) const;
+
+private:
+    std::vector<YOLODetector> detectors; // one per session
+    std::vector<size_t> levelDetectors;  // index into detectors of each level
+    std::vector<cv::Size> levelSizes;    // input size of each level
+    DeadlinePolicy policy;
+    DeadlineStats stats;
+
+    size_t level{0};
+    int missStreak{0};
+    int hitStreak{0};
+    bool lastMissed{false};
+
+    void updateLevel(const bool& missed, const bool& headroom);
+};
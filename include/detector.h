@@ -1,11 +1,105 @@
 #pragma once
 #include <opencv2/opencv.hpp>
 #include <onnxruntime_cxx_api.h>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <utility>
 
+#include "letterbox.h"
+#include "providers.h"
+#include "thread_pool.h"
 #include "utils.h"
+#include "watchdog.h"
 
 
+struct MemoryOptions
+{
+    bool enableCpuArena{true};       // false: every tensor is a plain allocation
+    bool useCustomArena{false};      // register an arena with the settings below on the Env
+    int arenaExtendStrategy{-1};     // 0: next power of two, 1: same as requested, -1: ORT default
+    int initialChunkSizeBytes{-1};   // -1: ORT default
+    int maxDeadBytesPerChunk{-1};    // -1: ORT default
+    size_t arenaMaxMemory{0};        // 0: no limit
+    bool shrinkArenaAfterRun{false}; // return free arena chunks to the system after every run
+    bool enableMemPattern{true};     // preplan the activation memory of the graph
+    bool releaseInputBufferAfterDetect{false}; // drop the input buffer after every detect, outputs are ORT's
+
+    // smallest footprint, at the cost of some latency
+    static MemoryOptions lowMemory()
+    {
+        MemoryOptions options;
+        options.useCustomArena = true;
+        options.arenaExtendStrategy = 1;
+        options.shrinkArenaAfterRun = true;
+        options.enableMemPattern = false;
+        options.releaseInputBufferAfterDetect = true;
+        return options;
+    }
+};
+
+struct PlacementOptions
+{
+    int numaNode{-1};          // pin to the cpus of this NUMA node, -1: use cpus
+    std::vector<int> cpus;     // cpus to pin to when numaNode is -1, empty: no pinning
+    int intraOpThreads{0};     // 0: one per pinned cpu, or ORT's default when not pinned
+    int preprocessThreads{0};  // pinned preprocessing workers, 0: OpenCV's pool
+};
+
+struct SharedEnvOptions
+{
+    int intraOpThreads{0};     // global intra-op pool, 0: one thread per core
+    int interOpThreads{0};     // global inter-op pool, 0: ORT default
+    bool allowSpinning{true};  // false: idle pool threads sleep instead of spinning
+    std::vector<int> cpus;     // pin the global pools to these cpus, empty: no pinning
+};
+
+struct DetectorOptions
+{
+    MemoryOptions memory;
+    PlacementOptions placement;
+    bool useSharedEnv{false};  // run on the process-wide Env and its global thread pools
+    SharedEnvOptions sharedEnv; // only used by the detector that creates the shared Env
+    ExecutionProvider provider{ExecutionProvider::CPU}; // used when not running on CUDA
+    std::string providerCachePath{"yolo_ort_providers.cache"}; // choices of ExecutionProvider::Auto
+};
+
+struct AdaptiveResolutionOptions
+{
+    std::vector<int> sizes{320, 480, 640}; // square input sizes, multiples of 32, all prewarmed
+    cv::Size frameSize;                    // source resolution used to prewarm, empty: square frames
+    float largeObjectArea{0.02f};   // smallest box, as a fraction of the frame, of a "large" frame
+    int maxSparseDetections{4};     // more detections than this are not "sparse"
+    float smallObjectArea{0.005f};  // a box below this fraction of the frame raises the resolution
+    float lowConfidence{0.5f};      // a mean confidence below this raises the resolution
+    int downscaleFrames{30};        // consecutive large and sparse frames before one step down
+    int upscaleFrames{2};           // consecutive detail frames before going back to the largest size
+    int emptyDetailFrames{5};       // empty frames after the last detections that count as detail frames
+};
+
+struct MemoryStats
+{
+    size_t rssBytes{};          // resident set size of the process
+    size_t peakRssBytes{};      // peak resident set size of the process
+    size_t inputBufferBytes{};  // input buffers kept by the detector
+    size_t arenaLimitBytes{};   // arenaMaxMemory of the options, not the arena usage, 0: no limit
+};
+
+// thrown by a detect with a deadline, the frame is abandoned
+class DeadlineExceeded : public std::runtime_error
+{
+public:
+    explicit DeadlineExceeded(const std::string& stage)
+        : std::runtime_error("Deadline exceeded during " + stage) {}
+};
+
+// plain detects may run concurrently, see YOLODetector::detect() for the exceptions
 class YOLODetector
 {
 public:
@@ -13,26 +107,275 @@ public:
     YOLODetector(const std::string& modelPath,
                  const bool& isGPU,
                  const cv::Size& inputSize);
+    YOLODetector(const std::string& modelPath,
+                 const bool& isGPU,
+                 const cv::Size& inputSize,
+                 const DetectorOptions& options);
 
     std::vector<Detection> detect(cv::Mat &image, const float& confThreshold, const float& iouThreshold);
+    std::vector<Detection> detect(cv::Mat &image, const float& confThreshold, const float& iouThreshold,
+                                  const std::chrono::steady_clock::time_point& deadline);
+    std::vector<std::vector<Detection>> detectBatch(std::vector<cv::Mat>& images,
+                                                    const float& confThreshold, const float& iouThreshold);
+    bool supportsBatch() const { return isDynamicBatch; }
+    bool supportsInputSizes() const { return isDynamicInputShape; }
+    std::vector<Detection> detectTopK(cv::Mat &image, const int& k,
+                                      const float& confThreshold, const float& iouThreshold);
+
+    // called on the inference thread, error is set instead of detections when the frame failed;
+    // queued frames refer to the detector, do not move it before waitAsync() returned;
+    // the callback must not call waitAsync(), detect*() or the setters of the same detector, they deadlock
+    using DetectCallback = std::function<void(std::vector<Detection> detections, std::exception_ptr error)>;
+    std::future<std::vector<Detection>> detectAsync(const cv::Mat& image, const float& confThreshold,
+                                                    const float& iouThreshold);
+    void detectAsync(const cv::Mat& image, const float& confThreshold, const float& iouThreshold,
+                     const DetectCallback& callback);
+    void waitAsync();
+
+    void setAllowedClasses(const std::vector<int>& classIds);
+    void setClassConfThreshold(const int& classId, const float& threshold);
+    void clearClassFilter();
+    void setAnchors(const std::vector<std::vector<float>>& anchors);
+    void setPreprocessThreads(const int& numThreads);
+    void setDecodeThreads(const int& numThreads);
+    void enableAdaptiveResolution(const AdaptiveResolutionOptions& options);
+    void disableAdaptiveResolution();
+    void setInputSize(const cv::Size& inputSize);
+    cv::Size getInputSize() const;
+
+    void releaseInputBuffers();
+    MemoryStats memoryStats() const;
 
 private:
+    // cpus of the placement, must outlive the session that pins its threads with them
+    std::shared_ptr<std::vector<int>> placementCpus;
+    std::shared_ptr<ThreadPool> preprocessPool;
+
+    // classes and thresholds chosen by the user, copied by async frames when they are queued
+    struct ClassSelection
+    {
+        std::vector<int> allowedClassIds;          // empty: all classes are allowed
+        std::map<int, float> classConfThresholds;  // overrides of confThreshold per class
+    };
+
+    // classes and thresholds of one decode, resolved against the model's class count
+    struct ClassFilter
+    {
+        std::vector<int> classIds;     // classes taking part in the argmax, empty: all classes
+        std::vector<float> thresholds; // confidence threshold of each class
+        float minThreshold{};          // rows with a lower objectness are rejected
+    };
+
+    enum class OutputLayout
+    {
+        Concatenated, // [1, N, 5 + C], boxes decoded in the graph
+        Transposed,   // [1, 4 + C, N], YOLOv8/v11 without objectness
+        RawHeads,     // one [1, na * (5 + C), ny, nx] or [1, na, ny, nx, 5 + C] logit tensor per stride
+        Filtered      // [1, k, 6] (cx, cy, w, h, conf, class id) rows, see tools/augment_postprocess.py
+    };
+
+    // collects every candidate of a decode
+    struct CandidateList
+    {
+        std::vector<cv::Rect> boxes;
+        std::vector<float> confs;
+        std::vector<int> classIds;
+
+        float bound() const { return 0.0f; }
+        void add(const cv::Rect& box, const float& conf, const int& classId)
+        {
+            boxes.emplace_back(box);
+            confs.emplace_back(conf);
+            classIds.emplace_back(classId);
+        }
+        // appends the candidates of a later chunk, keeping the row order of a serial decode
+        void merge(const CandidateList& other)
+        {
+            boxes.insert(boxes.end(), other.boxes.begin(), other.boxes.end());
+            confs.insert(confs.end(), other.confs.begin(), other.confs.end());
+            classIds.insert(classIds.end(), other.classIds.begin(), other.classIds.end());
+        }
+    };
+
+    // keeps only the most confident candidate of a decode
+    struct BestCandidate
+    {
+        cv::Rect box;
+        float conf{0.0f};
+        int classId{-1};
+
+        float bound() const { return conf; } // rows at or below the bound cannot win
+        void add(const cv::Rect& box, const float& conf, const int& classId)
+        {
+            if (conf > this->conf)
+            {
+                this->box = box;
+                this->conf = conf;
+                this->classId = classId;
+            }
+        }
+        // merged in row order, so ties go to the first row like in a serial decode
+        void merge(const BestCandidate& other)
+        {
+            if (other.classId >= 0)
+                this->add(other.box, other.conf, other.classId);
+        }
+    };
+
     Ort::Env env{nullptr};
+    std::shared_ptr<Ort::Env> sharedEnv; // set instead of env when useSharedEnv is on
     Ort::SessionOptions sessionOptions{nullptr};
     Ort::Session session{nullptr};
 
-    void preprocessing(cv::Mat &image, float*& blob, std::vector<int64_t>& inputTensorShape);
-    std::vector<Detection> postprocessing(const cv::Size& resizedImageShape,
+    static Ort::Session createSession(Ort::Env& env, const std::string& modelPath,
+                                      const Ort::SessionOptions& sessionOptions);
+    ExecutionProvider selectProvider(Ort::Env& env, const std::string& modelPath,
+                                     const cv::Size& inputSize, const DetectorOptions& options) const;
+    double timeProvider(Ort::Env& env, const std::string& modelPath, const cv::Size& inputSize,
+                        const ExecutionProvider& provider, const int& numThreads) const;
+    static std::shared_ptr<Ort::Env> getSharedEnv(const SharedEnvOptions& options);
+    static void registerSharedArena(const std::shared_ptr<Ort::Env>& env, const MemoryOptions& options);
+    static OrtCustomThreadHandle createPinnedThread(void* options, OrtThreadWorkerFn workerFn,
+                                                    void* workerParam);
+    static void joinPinnedThread(OrtCustomThreadHandle handle);
+
+    void preprocessing(const cv::Mat& image, utils::LetterboxPlan& plan, std::vector<float>& blob,
+                       std::vector<int64_t>& inputTensorShape);
+    struct InputBuffers;
+    std::vector<Ort::Value> inference(cv::Mat &image, InputBuffers& buffers, cv::Size& resizedImageShape);
+    std::vector<Detection> postprocessing(const utils::LetterboxPlan& plan,
+                                          const cv::Size& resizedImageShape,
                                           const cv::Size& originalImageShape,
                                           std::vector<Ort::Value>& outputTensors,
-                                          const float& confThreshold, const float& iouThreshold);
+                                          const float& confThreshold, const float& iouThreshold,
+                                          const ClassSelection& classes);
+    std::vector<Detection> postprocessingTopK(const utils::LetterboxPlan& plan,
+                                              const cv::Size& resizedImageShape,
+                                              const cv::Size& originalImageShape,
+                                              std::vector<Ort::Value>& outputTensors,
+                                              const int& k,
+                                              const float& confThreshold, const float& iouThreshold,
+                                              const ClassSelection& classes);
+
+    template <typename Sink>
+    void decode(const cv::Size& resizedImageShape, std::vector<Ort::Value>& outputTensors,
+                const float& confThreshold, const ClassSelection& classes, Sink& sink) const;
+    template <typename Sink, typename DecodeChunk>
+    void decodeChunked(const size_t& numRows, const size_t& rowBytes, Sink& sink,
+                       const DecodeChunk& decodeChunk) const;
+    template <typename Sink>
+    void decodeRows(std::vector<Ort::Value>& outputTensors, const float& confThreshold,
+                    const ClassSelection& classes, Sink& sink) const;
+    template <int NumClasses, typename Sink>
+    static void decodeRowsFixed(const float* rawOutput, const size_t& numRows,
+                                const ClassFilter& filter, Sink& sink);
+    template <typename Sink>
+    void decodeTransposed(std::vector<Ort::Value>& outputTensors, const float& confThreshold,
+                          const ClassSelection& classes, Sink& sink) const;
+    template <typename Sink>
+    void decodeFiltered(std::vector<Ort::Value>& outputTensors, const float& confThreshold,
+                        const ClassSelection& classes, Sink& sink) const;
+    template <typename Sink>
+    void decodeHeads(const cv::Size& resizedImageShape, std::vector<Ort::Value>& outputTensors,
+                     const float& confThreshold, const ClassSelection& classes, Sink& sink) const;
 
-    static void getBestClassInfo(std::vector<float>::iterator it, const int& numClasses,
+    static ClassFilter makeClassFilter(const int& numClasses, const float& confThreshold,
+                                       const ClassSelection& classes);
+    static bool scoreRow(const float* it, const int& numClasses, const ClassFilter& filter,
+                         float& confidence, int& classId);
+    static void getBestClassInfo(const float* it, const int& numClasses,
                                  float& bestConf, int& bestClassId);
+    static void getBestClassInfo(const float* it, const std::vector<int>& classIds,
+                                 float& bestConf, int& bestClassId);
+    template <int NumClasses>
+    static void getBestClassInfoFixed(const float* it, float& bestConf, int& bestClassId);
+    void checkDeadline(const char* stage) const;
+    void updateAdaptiveResolution(const std::vector<Detection>& detections, const cv::Size& imageShape);
+    void setInputSizeIndex(const size_t& index);
+    static cv::Rect scaleBox(const cv::Rect& box, const utils::LetterboxPlan& plan,
+                             const cv::Size& resizedImageShape, const cv::Size& originalImageShape);
+    static cv::Rect getBox(const float* it);
+    static cv::Rect getBox(const float& centerX, const float& centerY,
+                           const float& width, const float& height);
 
-    std::vector<const char*> inputNames;
+    std::vector<std::string> inputNameStorage;  // owns the names, the vectors are not resized afterwards
+    std::vector<std::string> outputNameStorage;
+    std::vector<const char*> inputNames;        // c_str() of the storage, as Session::Run takes them
     std::vector<const char*> outputNames;
     bool isDynamicInputShape{};
+    bool isDynamicBatch{};              // batch axis of the input is dynamic, see detectBatch()
     cv::Size2f inputImageShape;
+    OutputLayout outputLayout{OutputLayout::Concatenated};
+    int fixedNumClasses{0}; // class count with a specialized row decoder, 0: generic decoder
+    int filteredNumClasses{0}; // class count of a Filtered model from its metadata, 0: unknown
+    int preprocessThreads{1};           // row bands of the preprocessing, 1: calling thread only
+    int decodeThreads{1};               // workers of the row and anchor decode, 1: calling thread only
+
+    // only used with a dynamic input shape, see enableAdaptiveResolution()
+    bool adaptiveResolution{false};
+    AdaptiveResolutionOptions adaptiveOptions;
+    size_t adaptiveSizeIndex{0};
+    int downscaleStreak{0};
+    int upscaleStreak{0};
+    int emptyDetailBudget{0}; // empty frames left that count as detail frames, refilled by detections
+
+    // deadline of the current detect, max(): none
+    std::chrono::steady_clock::time_point deadline{std::chrono::steady_clock::time_point::max()};
+    std::shared_ptr<RunWatchdog> watchdog; // created by the first detect with a deadline
+
+    MemoryOptions memoryOptions;
+
+    // letterbox plans and blob of one detect, reused by later calls
+    struct InputBuffers
+    {
+        utils::LetterboxPlan plan;                    // rebuilt only when the source resolution changes
+        std::vector<utils::LetterboxPlan> batchPlans; // one per source resolution seen in batches
+        std::vector<float> blob;
+    };
+
+    // buffers of the detects not running, concurrent detects take one each
+    struct InputBufferPool
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<InputBuffers>> buffers;
+
+        std::unique_ptr<InputBuffers> acquire();
+        void release(std::unique_ptr<InputBuffers> inputBuffers, const bool& freeBlob);
+    };
+    std::unique_ptr<InputBufferPool> inputBufferPool{new InputBufferPool()};
+
+    // (w, h) pairs of each detection head, from the finest to the coarsest stride
+    std::vector<std::vector<float>> anchors {
+        {10, 13, 16, 30, 33, 23},       // P3/8
+        {30, 61, 62, 45, 59, 119},      // P4/16
+        {116, 90, 156, 198, 373, 326}   // P5/32
+    };
+
+    ClassSelection classSelection;             // set by setAllowedClasses() and setClassConfThreshold()
+
+    // input of one frame of detectAsync, from its preprocessing until its callback returned
+    struct AsyncSlot
+    {
+        std::vector<float> blob;
+        std::vector<int64_t> inputTensorShape {1, 3, -1, -1};
+        utils::LetterboxPlan plan; // rebuilt only when the source resolution changes
+    };
+
+    // double buffered pipeline of detectAsync: the caller preprocesses into one
+    // slot while the model runs on the other
+    struct AsyncPipeline
+    {
+        AsyncSlot slots[2];
+        std::vector<size_t> freeSlots {1, 0};
+        size_t inFlight{0};
+        std::mutex mutex;
+        std::condition_variable condition;
+        ThreadPool inferenceStage{1}; // last, so its queued frames finish before the slots go away
+
+        size_t acquireSlot();
+        void releaseSlot(const size_t& index);
+        void wait();
+    };
+    std::unique_ptr<AsyncPipeline> asyncPipeline; // created by the first detectAsync, last member
 
 };
\ No newline at end of file
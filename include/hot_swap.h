@@ -0,0 +1,91 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "detector.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+
+struct HotSwapOptions
+{
+    bool watchFile{false};                        // reload when the model file changes on disk
+    std::chrono::milliseconds pollInterval{1000}; // between two checks of the file's size and mtime
+    int warmupRuns{3};                            // detects on a blank frame before a model takes over
+    cv::Size warmupFrameSize;                     // size of the blank frame, empty: the input size
+};
+
+struct HotSwapStats
+{
+    int generation{};       // models switched to since the construction
+    size_t failedLoads{};   // reloads that kept the previous model
+    double lastLoadMs{};    // load and warm-up time of the current model
+    std::string modelPath;  // of the current model
+};
+
+/**
+ * @brief Detector handle whose model can be replaced without a restart
+ * 
+ * A new model is loaded and warmed up on a background thread while the current
+ * one keeps serving, then switched to atomically: requests already running
+ * finish on the old session, which is released by the last of them, and later
+ * requests use the new one. A failed load keeps the current model.
+ * Requests may come from several threads, they are serialized per model.
+ */
+class HotSwapDetector
+{
+public:
+    HotSwapDetector(const std::string& modelPath, const bool& isGPU, const cv::Size& inputSize,
+                    const DetectorOptions& detectorOptions, const HotSwapOptions& options);
+    ~HotSwapDetector();
+
+    HotSwapDetector(const HotSwapDetector&) = delete;
+    HotSwapDetector& operator=(const HotSwapDetector&) = delete;
+
+    std::vector<Detection> detect(cv::Mat &image, const float& confThreshold, const float& iouThreshold);
+    std::vector<Detection> detectTopK(cv::Mat &image, const int& k,
+                                      const float& confThreshold, const float& iouThreshold);
+
+    std::future<bool> reload();
+    std::future<bool> reload(const std::string& modelPath);
+
+    HotSwapStats getStats() const;
+
+private:
+    // one loaded model, shared by the requests running on it
+    struct Instance
+    {
+        Instance(const std::string& modelPath, const bool& isGPU, const cv::Size& inputSize,
+                 const DetectorOptions& options)
+            : detector(modelPath, isGPU, inputSize, options) {}
+
+        YOLODetector detector;
+        std::mutex mutex; // the detector serves one request at a time
+    };
+
+    bool isGPU;
+    cv::Size inputSize;
+    DetectorOptions detectorOptions;
+    HotSwapOptions options;
+
+    mutable std::mutex mutex; // guards current and stats
+    std::shared_ptr<Instance> current;
+    HotSwapStats stats;
+
+    std::thread watcher;
+    std::condition_variable watcherCondition;
+    bool stopping{false};
+
+    ThreadPool loader{1}; // last, so a pending load finishes before the members it uses go away
+
+    std::shared_ptr<Instance> acquire() const;
+    std::shared_ptr<Instance> createInstance(const std::string& modelPath) const;
+    bool load(const std::string& modelPath);
+    void watch();
+};
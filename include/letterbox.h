@@ -0,0 +1,73 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+
+#include "thread_pool.h"
+
+
+namespace utils
+{
+    /**
+     * @brief Letterbox geometry of one (source size, target size, stride) combination
+     * 
+     * Holds the ratio and padding together with precomputed bilinear index/weight
+     * tables, so fixed-resolution sources only compute them once. The same plan
+     * is used to preprocess the image and to scale the boxes back.
+     */
+    class LetterboxPlan
+    {
+    public:
+        LetterboxPlan() = default;
+        LetterboxPlan(const cv::Size& sourceShape,
+                      const cv::Size& newShape,
+                      bool auto_,
+                      bool scaleUp,
+                      int stride);
+
+        bool matches(const cv::Size& sourceShape,
+                     const cv::Size& newShape,
+                     bool auto_,
+                     bool scaleUp,
+                     int stride) const;
+
+        void run(const cv::Mat& image, float* blob, const cv::Scalar& color) const;
+        void run(const cv::Mat& image, float* blob, const cv::Scalar& color,
+                 int rowBegin, int rowEnd) const;
+        void runParallel(const cv::Mat& image, float* blob, const cv::Scalar& color,
+                         int numBands) const;
+        void runParallel(const cv::Mat& image, float* blob, const cv::Scalar& color,
+                         ThreadPool& pool) const;
+
+        static cv::Mat toBgr(const cv::Mat& image);
+
+        cv::Rect forward(const cv::Rect& box) const;
+        cv::Rect inverse(const cv::Rect& box) const;
+
+        cv::Size inputShape() const { return sourceShape; }
+        cv::Size outputShape() const { return outShape; }
+        float getRatio() const { return ratio; }
+        cv::Point getPadding() const { return cv::Point(padLeft, padTop); }
+
+    private:
+        cv::Size sourceShape;
+        cv::Size newShape;
+        bool auto_{};
+        bool scaleUp{};
+        int stride{};
+
+        float ratio{};
+        cv::Size unpadShape; // shape of the resized image without padding
+        cv::Size outShape;   // shape of the letterboxed image
+        int padLeft{};
+        int padTop{};
+
+        // bilinear tables, x offsets are in bytes of a 3-channel 8-bit row
+        std::vector<int> xOffsets0, xOffsets1;
+        std::vector<float> xWeights;
+        std::vector<int> yIndices0, yIndices1;
+        std::vector<float> yWeights;
+
+        static void buildTable(int sourceLength, int resizedLength,
+                               std::vector<int>& indices0, std::vector<int>& indices1,
+                               std::vector<float>& weights);
+    };
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "utils.h"
+
+
+/**
+ * @brief Persistent results of a directory run, so re-runs only detect new or changed files
+ * 
+ * A file is reused when its size and mtime are unchanged, or when they changed but
+ * its content hash did not. The model hash and thresholds are part of the manifest,
+ * any change of them invalidates every entry. The previous manifest is memory-mapped
+ * and searched by binary search, so checking millions of entries reads only the
+ * pages that are touched.
+ */
+class ResultsManifest
+{
+public:
+    ResultsManifest(const std::string& manifestPath, const uint64_t& configHash);
+    ~ResultsManifest();
+
+    ResultsManifest(const ResultsManifest&) = delete;
+    ResultsManifest& operator=(const ResultsManifest&) = delete;
+
+    static uint64_t hashFile(const std::string& path);
+    static uint64_t hashConfig(const std::string& modelPath, const cv::Size& inputSize,
+                               const float& confThreshold, const float& iouThreshold);
+
+    bool lookup(const std::string& imagePath, std::vector<Detection>& detections);
+    void record(const std::string& imagePath, const std::vector<Detection>& detections);
+    bool save();
+
+    size_t getReused() const { return reused; }
+    size_t getProcessed() const { return processed; }
+
+private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t configHash;
+        uint64_t numRecords;
+        uint64_t numDetections;
+    };
+
+    struct Record
+    {
+        uint64_t pathHash;
+        uint64_t size;
+        int64_t mtime;
+        uint64_t contentHash;
+        uint64_t firstDetection;
+        uint64_t numDetections;
+    };
+
+    struct StoredDetection
+    {
+        int32_t x, y, width, height;
+        float conf;
+        int32_t classId;
+    };
+
+    struct FileIdentity
+    {
+        uint64_t size{};
+        int64_t mtime{};
+        uint64_t contentHash{};
+        bool hashed{false};
+    };
+
+    std::string manifestPath;
+    uint64_t configHash;
+
+    // previous manifest, mapped read-only
+    const char* mappedData{nullptr};
+    size_t mappedSize{0};
+#ifdef _WIN32
+    void* fileHandle{nullptr};
+    void* mappingHandle{nullptr};
+#endif
+    const Record* records{nullptr};      // sorted by pathHash
+    size_t numRecords{0};
+    const StoredDetection* storedDetections{nullptr};
+    size_t numStoredDetections{0};
+
+    // manifest written by save()
+    std::vector<Record> newRecords;
+    std::vector<StoredDetection> newDetections;
+    std::unordered_set<uint64_t> visited;                  // path hashes looked up or recorded this run
+    std::unordered_map<uint64_t, FileIdentity> identities; // computed by lookup, reused by record
+
+    size_t reused{0};
+    size_t processed{0};
+
+    bool map();
+    void unmap();
+    const Record* find(const uint64_t& pathHash) const;
+    void append(const Record& record, const StoredDetection* detections);
+    static bool statFile(const std::string& path, FileIdentity& identity);
+    static uint64_t hashString(const std::string& str);
+};
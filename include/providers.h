@@ -0,0 +1,29 @@
+#pragma once
+#include <onnxruntime_cxx_api.h>
+#include <string>
+#include <vector>
+
+
+enum class ExecutionProvider
+{
+    Auto,     // benchmark the available providers on the model, see YOLODetector
+    CPU,      // ORT's default CPU kernels
+    XNNPACK,
+    DNNL,     // oneDNN, needs a build with YOLO_ORT_WITH_DNNL
+    OpenVINO  // OpenVINO on the CPU device
+};
+
+namespace utils
+{
+    std::string providerName(const ExecutionProvider& provider);
+    bool parseProvider(const std::string& name, ExecutionProvider& provider);
+
+    std::vector<ExecutionProvider> getAvailableCpuProviders();
+    bool appendExecutionProvider(Ort::SessionOptions& sessionOptions, const ExecutionProvider& provider,
+                                 const int& numThreads);
+    bool appendAvailableProvider(Ort::SessionOptions& sessionOptions, const ExecutionProvider& provider,
+                                 const int& numThreads);
+
+    bool loadCachedProvider(const std::string& cachePath, const std::string& key, ExecutionProvider& provider);
+    void storeCachedProvider(const std::string& cachePath, const std::string& key, const ExecutionProvider& provider);
+}
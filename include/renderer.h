@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+
+#include "thread_pool.h"
+#include "utils.h"
+
+
+struct EncoderOptions
+{
+    int jpegQuality{90};      // used for .jpg/.jpeg outputs
+    int pngCompression{1};    // 0-9, low values encode faster, used for .png outputs
+};
+
+struct RenderStats
+{
+    size_t submitted{};
+    size_t dropped{};   // rejected because the queue was full
+    size_t written{};
+    size_t failed{};
+};
+
+/**
+ * @brief Draws detections and encodes the annotated images on a worker pool
+ * 
+ * submit() never blocks: when the bounded queue is full the frame is dropped.
+ * Labels are pre-rendered once per class and confidence bucket.
+ */
+class AsyncRenderer
+{
+public:
+    AsyncRenderer(const std::vector<std::string>& classNames,
+                  const int& numWorkers,
+                  const int& queueCapacity,
+                  const EncoderOptions& encoderOptions);
+    ~AsyncRenderer();
+
+    bool submit(cv::Mat image, const std::vector<Detection>& detections, const std::string& outputPath);
+    void flush();
+
+    RenderStats getStats() const;
+
+private:
+    std::vector<std::string> classNames;
+    int queueCapacity;
+    EncoderOptions encoderOptions;
+
+    std::atomic<int> pending{0};
+    std::atomic<size_t> submitted{0}, dropped{0}, written{0}, failed{0};
+    std::mutex flushMutex;
+    std::condition_variable flushCondition;
+
+    std::mutex spriteMutex;
+    std::map<std::pair<int, int>, cv::Mat> sprites; // (class id, confidence in %) -> label
+
+    // declared last, so the workers are joined before the members they use are destroyed
+    ThreadPool pool;
+
+    void render(cv::Mat& image, const std::vector<Detection>& detections);
+    cv::Mat getSprite(const int& classId, const int& confPercent);
+    std::vector<int> encoderParams(const std::string& outputPath) const;
+};
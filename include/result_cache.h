@@ -0,0 +1,92 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <unordered_map>
+
+#include "detector.h"
+#include "utils.h"
+
+
+enum class ImageHash
+{
+    Difference, // utils::differenceHash, fastest
+    Perceptual  // utils::perceptualHash, more tolerant to noise
+};
+
+struct ResultCacheOptions
+{
+    ImageHash hash{ImageHash::Difference};
+    int maxHammingDistance{2};  // near-duplicate tolerance in bits, 0: identical hashes only
+    size_t maxBytes{1 << 20};   // memory bound of the cached results, least recently used go first
+    float maxAspectChange{0.02f}; // relative aspect ratio change still treated as the same picture
+};
+
+struct ResultCacheStats
+{
+    size_t lookups{};
+    size_t hits{};
+    size_t entries{};
+    size_t bytes{};
+    double savedMs{};   // estimated: mean detect time of misses minus the time of each hit
+
+    double hitRate() const { return lookups ? (double)hits / (double)lookups : 0.0; }
+};
+
+/**
+ * @brief Returns the stored detections of duplicate and near-duplicate frames
+ * 
+ * Frames are keyed by a 64-bit perceptual hash of a thumbnail. Detections are
+ * stored relative to the image size, so a hit at another resolution is rescaled.
+ * Not thread-safe, like the detector it wraps.
+ */
+class CachedDetector
+{
+public:
+    CachedDetector(YOLODetector& detector, const ResultCacheOptions& options);
+
+    std::vector<Detection> detect(cv::Mat &image, const float& confThreshold, const float& iouThreshold);
+
+    void clear();
+    ResultCacheStats getStats() const;
+    void printStats(std::ostream& os) const;
+
+private:
+    struct CachedBox
+    {
+        cv::Rect2f box; // relative to the image size
+        float conf;
+        int classId;
+    };
+
+    struct Entry
+    {
+        uint64_t hash;
+        float aspect;
+        float confThreshold;
+        float iouThreshold;
+        std::vector<CachedBox> boxes;
+        size_t bytes;
+    };
+
+    YOLODetector& detector;
+    ResultCacheOptions options;
+    ResultCacheStats stats;
+
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    size_t bytes{0};
+
+    size_t misses{0};
+    double missTimeMs{0.0};
+
+    uint64_t hashImage(const cv::Mat& image) const;
+    std::list<Entry>::iterator find(const uint64_t& hash, const float& aspect,
+                                    const float& confThreshold, const float& iouThreshold);
+    void insert(const uint64_t& hash, const float& aspect, const cv::Size& imageShape,
+                const float& confThreshold, const float& iouThreshold,
+                const std::vector<Detection>& detections);
+    void evict();
+};
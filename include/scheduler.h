@@ -0,0 +1,100 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "detector.h"
+#include "utils.h"
+
+
+struct StreamConfig
+{
+    int weight{1};                          // frames per round relative to the other streams
+    std::chrono::milliseconds maxStaleness{200}; // older frames are dropped instead of detected
+    size_t queueCapacity{4};                // the oldest frame is dropped when a full queue gets a new one
+};
+
+struct SchedulerConfig
+{
+    int maxBatchSize{8};
+    std::chrono::milliseconds maxBatchDelay{5}; // wait this long for a batch to fill up
+    float confThreshold{0.4f};
+    float iouThreshold{0.45f};
+};
+
+struct StreamStats
+{
+    size_t submitted{};
+    size_t processed{};
+    size_t droppedOverflow{}; // dropped by a newer frame on a full queue
+    size_t droppedStale{};    // dropped for exceeding maxStaleness
+    size_t droppedFailed{};   // in a batch whose model run threw, their callbacks are not invoked
+    double totalLatencyMs{};  // submit to result, summed over the processed frames
+    double maxLatencyMs{};
+    double elapsedSeconds{};  // since the stream was added
+
+    double meanLatencyMs() const { return processed ? totalLatencyMs / (double)processed : 0.0; }
+    double fps() const { return elapsedSeconds > 0.0 ? (double)processed / elapsedSeconds : 0.0; }
+};
+
+/**
+ * @brief Batches the frames of many streams into shared model runs
+ * 
+ * Frames are picked by deficit round-robin over the stream weights, so a bursting
+ * stream only fills its own queue. Results are delivered on the scheduler thread.
+ */
+class StreamScheduler
+{
+public:
+    // (stream id, frame, detections)
+    using ResultCallback = std::function<void(int, const cv::Mat&, const std::vector<Detection>&)>;
+
+    StreamScheduler(YOLODetector& detector, const SchedulerConfig& config, const ResultCallback& callback);
+    ~StreamScheduler();
+
+    int addStream(const StreamConfig& config);
+    bool submit(const int& streamId, const cv::Mat& frame);
+    void stop();
+
+    StreamStats getStats(const int& streamId) const;
+    void printStats(std::ostream& os) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Frame
+    {
+        cv::Mat image;
+        Clock::time_point submitted;
+    };
+
+    struct Stream
+    {
+        StreamConfig config;
+        std::deque<Frame> queue;
+        int deficit{0};
+        Clock::time_point added;
+        StreamStats stats;
+    };
+
+    YOLODetector& detector;
+    SchedulerConfig config;
+    ResultCallback callback;
+
+    mutable std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<Stream> streams;
+    size_t queuedFrames{0};
+    size_t nextStream{0}; // round-robin position, kept across batches
+    bool stopping{false};
+
+    std::thread thread;
+
+    void loop();
+    std::vector<std::pair<int, Frame>> takeBatch();
+};
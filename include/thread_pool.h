@@ -0,0 +1,58 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+/**
+ * @brief Fixed-size worker pool, optionally pinned to a set of cpus
+ */
+class ThreadPool
+{
+public:
+    explicit ThreadPool(const int& numThreads, const std::vector<int>& cpus = std::vector<int>());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename F>
+    auto enqueue(F&& task) -> std::future<decltype(task())>;
+
+    void parallelFor(const int& numTasks, const std::function<void(int)>& task);
+
+    int size() const { return (int)workers.size(); }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping{false};
+};
+
+/**
+ * @brief Queue a task on the pool
+ * 
+ * @param task Callable without arguments
+ * @return std::future of the task result
+ */
+template <typename F>
+auto ThreadPool::enqueue(F&& task) -> std::future<decltype(task())>
+{
+    using Result = decltype(task());
+    auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    std::future<Result> future = packagedTask->get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.emplace([packagedTask]() { (*packagedTask)(); });
+    }
+    condition.notify_one();
+
+    return future;
+}
@@ -1,6 +1,8 @@
 #pragma once
+#include <cstdint>
 #include <codecvt>
 #include <fstream>
+#include <limits>
 #include <opencv2/opencv.hpp>
 
 
@@ -31,6 +33,24 @@ namespace utils
 
     void scaleCoords(const cv::Size& imageShape, cv::Rect& box, const cv::Size& imageOriginalShape);
 
+    float computeIoU(const cv::Rect& box1, const cv::Rect& box2);
+
+    void getMemoryUsage(size_t& rssBytes, size_t& peakRssBytes);
+
+    int getNumaNodeCount();
+    std::vector<int> getNumaNodeCpus(const int& node);
+    bool setThreadAffinity(const std::vector<int>& cpus);
+
+    uint64_t hashFile(const std::string& path);
+    bool statFile(const std::string& path, uint64_t& size, int64_t& mtime);
+
+    uint64_t differenceHash(const cv::Mat& image);
+    uint64_t perceptualHash(const cv::Mat& image);
+    int hammingDistance(const uint64_t& hash1, const uint64_t& hash2);
+
+    float sigmoid(const float& x);
+    float logit(const float& p);
+
     template <typename T>
     T clip(const T& n, const T& lower, const T& upper);
 }
@@ -0,0 +1,37 @@
+#pragma once
+#include <onnxruntime_cxx_api.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+/**
+ * @brief Terminates an ORT run that is still going at its deadline
+ * 
+ * One background thread serves every run of its owner, one run at a time.
+ */
+class RunWatchdog
+{
+public:
+    RunWatchdog();
+    ~RunWatchdog();
+
+    RunWatchdog(const RunWatchdog&) = delete;
+    RunWatchdog& operator=(const RunWatchdog&) = delete;
+
+    void arm(Ort::RunOptions& runOptions, const std::chrono::steady_clock::time_point& deadline);
+    bool disarm();
+
+private:
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+
+    Ort::RunOptions* runOptions{nullptr}; // run being watched, nullptr: disarmed
+    std::chrono::steady_clock::time_point deadline;
+    bool fired{false};
+    bool stopping{false};
+
+    void loop();
+};
@@ -0,0 +1,76 @@
+#pragma once
+/*
+ * C API of yolo_ort_core, for hosts that keep a warm session in-process.
+ * 
+ * Functions returning int return a negative value on failure,
+ * yolo_ort_last_error() then describes the error of the calling thread.
+ * 
+ * yolo_ort_detect and yolo_ort_detect_batch may run concurrently on the same
+ * handle, each call uses its own input buffers.
+ */
+
+#ifdef _WIN32
+    #ifdef YOLO_ORT_EXPORTS
+        #define YOLO_ORT_API __declspec(dllexport)
+    #elif defined(YOLO_ORT_SHARED)
+        #define YOLO_ORT_API __declspec(dllimport)
+    #else
+        #define YOLO_ORT_API
+    #endif
+#else
+    #define YOLO_ORT_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct yolo_ort_detector yolo_ort_detector;
+
+typedef struct
+{
+    int x;
+    int y;
+    int width;
+    int height;
+    float conf;
+    int class_id;
+} yolo_ort_detection;
+
+typedef struct
+{
+    const unsigned char* data; /* 8-bit BGR pixels */
+    int width;
+    int height;
+    int stride;                /* bytes per row, 0: width * 3 */
+} yolo_ort_image;
+
+/* returns NULL on failure */
+YOLO_ORT_API yolo_ort_detector* yolo_ort_create(const char* model_path, int use_gpu,
+                                                int input_width, int input_height);
+YOLO_ORT_API void yolo_ort_destroy(yolo_ort_detector* detector);
+
+/*
+ * Detect objects of one image into detections[0 .. capacity - 1].
+ * Returns the number of detections found, which may exceed capacity; only capacity are written.
+ */
+YOLO_ORT_API int yolo_ort_detect(yolo_ort_detector* detector, const yolo_ort_image* image,
+                                 float conf_threshold, float iou_threshold,
+                                 yolo_ort_detection* detections, int capacity);
+
+/*
+ * Detect objects of num_images images. The detections of image i are written to
+ * detections[i * capacity_per_image ...] and their number found to counts[i].
+ * The images share one model run when the model has a dynamic batch axis.
+ * Returns 0, or a negative value if any image failed; counts[i] is -1 for a failed image.
+ */
+YOLO_ORT_API int yolo_ort_detect_batch(yolo_ort_detector* detector, const yolo_ort_image* images,
+                                       int num_images, float conf_threshold, float iou_threshold,
+                                       yolo_ort_detection* detections, int capacity_per_image,
+                                       int* counts);
+
+YOLO_ORT_API const char* yolo_ort_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,128 @@
+#include "cascade.h"
+
+/**
+ * @brief Construct a new CascadeDetector object
+ * 
+ * @param smallModelPath Path to the small, fast onnx model run on every frame
+ * @param largeModelPath Path to the large onnx model run on ambiguous frames
+ * @param isGPU Inference on GPU
+ * @param smallInputSize Input size of the small model
+ * @param largeInputSize Input size of the large model
+ * @param config Escalation band and ROIs
+*/
+CascadeDetector::CascadeDetector(const std::string& smallModelPath,
+                                 const std::string& largeModelPath,
+                                 const bool& isGPU,
+                                 const cv::Size& smallInputSize,
+                                 const cv::Size& largeInputSize,
+                                 const CascadeConfig& config)
+    : config(config)
+{
+    small = YOLODetector(smallModelPath, isGPU, smallInputSize);
+    large = YOLODetector(largeModelPath, isGPU, largeInputSize);
+}
+
+/**
+ * @brief Get the most confident detection
+ * 
+ * @param detections Detections
+ * @return const Detection* nullptr if there is no detection
+ */
+const Detection* CascadeDetector::topDetection(const std::vector<Detection>& detections)
+{
+    const Detection* top = nullptr;
+    for (const Detection& detection : detections)
+    {
+        if (top == nullptr || detection.conf > top->conf)
+            top = &detection;
+    }
+
+    return top;
+}
+
+/**
+ * @brief Check if the small model result has to be confirmed by the large model
+ * 
+ * @param detections Detections of the small model
+ * @param topConf Top confidence of the small model, 0 if there is no detection
+ * @return true if the frame is ambiguous or touches a configured ROI
+ */
+bool CascadeDetector::needsEscalation(const std::vector<Detection>& detections, const float& topConf) const
+{
+    if (topConf >= config.lowConf && topConf < config.highConf)
+        return true;
+
+    for (const cv::Rect& roi : config.rois)
+    {
+        for (const Detection& detection : detections)
+        {
+            if ((detection.box & roi).area() > 0)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Detect objects with the small model, escalating to the large model when ambiguous
+ * 
+ * @param image Input image
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @return std::vector<Detection> Detections of the model that decided the frame
+*/
+std::vector<Detection> CascadeDetector::detect(cv::Mat &image, const float& confThreshold,
+                                               const float& iouThreshold)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Detection> smallResult = small.detect(image, confThreshold, iouThreshold);
+    auto smallEnd = std::chrono::steady_clock::now();
+
+    stats.frames++;
+    stats.smallTimeMs += std::chrono::duration<double, std::milli>(smallEnd - start).count();
+
+    const Detection* smallTop = topDetection(smallResult);
+    float topConf = smallTop ? smallTop->conf : 0.0f;
+    if (!this->needsEscalation(smallResult, topConf))
+        return smallResult;
+
+    std::vector<Detection> largeResult = large.detect(image, confThreshold, iouThreshold);
+    auto largeEnd = std::chrono::steady_clock::now();
+
+    stats.escalations++;
+    stats.largeTimeMs += std::chrono::duration<double, std::milli>(largeEnd - smallEnd).count();
+
+    // both models agree when they find nothing, or the same top object
+    const Detection* largeTop = topDetection(largeResult);
+    if (smallTop == nullptr || largeTop == nullptr)
+    {
+        if (smallTop == largeTop)
+            stats.agreements++;
+    }
+    else if (smallTop->classId == largeTop->classId &&
+             utils::computeIoU(smallTop->box, largeTop->box) >= config.agreementIoU)
+    {
+        stats.agreements++;
+    }
+
+    return largeResult;
+}
+
+/**
+ * @brief Print escalation rate, latency and agreement of the cascade
+ * 
+ * @param os Output stream
+ */
+void CascadeDetector::printStats(std::ostream& os) const
+{
+    os << "Cascade frames: " << stats.frames << std::endl;
+    os << "Escalation rate: " << stats.escalationRate() * 100.0 << "%"
+       << " (band [" << config.lowConf << ", " << config.highConf << "), "
+       << config.rois.size() << " ROIs)" << std::endl;
+    os << "Agreement rate: " << stats.agreementRate() * 100.0 << "%" << std::endl;
+    os << "Mean latency: " << stats.meanLatencyMs() << " ms"
+       << " (small " << (stats.frames ? stats.smallTimeMs / (double)stats.frames : 0.0) << " ms"
+       << ", large " << (stats.escalations ? stats.largeTimeMs / (double)stats.escalations : 0.0)
+       << " ms per escalation)" << std::endl;
+}
@@ -0,0 +1,150 @@
+#include "deadline.h"
+
+/**
+ * @brief Construct a new DeadlineDetector object
+ * 
+ * @param levels Models and input sizes, from the most accurate to the cheapest
+ * @param isGPU Inference on GPU
+ * @param frameSize Resolution of the incoming frames, used to prewarm every level
+ * @param policy Fallback and recovery thresholds
+*/
+DeadlineDetector::DeadlineDetector(const std::vector<DeadlineLevel>& levels,
+                                   const bool& isGPU,
+                                   const cv::Size& frameSize,
+                                   const DeadlinePolicy& policy)
+    : policy(policy)
+{
+    if (levels.empty())
+        throw std::invalid_argument("DeadlineDetector needs at least one level");
+
+    cv::Mat frame = cv::Mat::zeros(frameSize, CV_8UC3);
+    std::vector<std::string> detectorPaths;
+    for (const DeadlineLevel& deadlineLevel : levels)
+    {
+        // a dynamic-shape model already loaded runs the level at its size, a fallback
+        // then switches the size instead of the session
+        size_t index = 0;
+        while (index < detectors.size() &&
+               !(detectorPaths[index] == deadlineLevel.modelPath && detectors[index].supportsInputSizes()))
+            index++;
+
+        if (index == detectors.size())
+        {
+            detectors.emplace_back(deadlineLevel.modelPath, isGPU, deadlineLevel.inputSize);
+            detectorPaths.push_back(deadlineLevel.modelPath);
+        }
+        else
+            detectors[index].setInputSize(deadlineLevel.inputSize);
+
+        levelDetectors.push_back(index);
+        levelSizes.push_back(deadlineLevel.inputSize);
+
+        // the first run at each size allocates and plans the graph, keep it out of the budget
+        detectors[index].detect(frame, 0.4f, 0.45f);
+    }
+
+    this->resetStats();
+}
+
+/**
+ * @brief Detect objects on the current level within the budget
+ * 
+ * A missed frame returns no detections, the caller keeps its previous result
+ * or skips the frame.
+ * 
+ * @param image Input image
+ * @param budget Latency budget of the frame, measured from this call
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @return std::vector<Detection> Empty if the frame was abandoned
+*/
+std::vector<Detection> DeadlineDetector::detect(cv::Mat &image, const std::chrono::microseconds& budget,
+                                                const float& confThreshold, const float& iouThreshold)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + budget;
+
+    stats.frames++;
+    stats.levelFrames[level]++;
+
+    std::vector<Detection> result;
+    bool missed = false;
+    try
+    {
+        YOLODetector& detector = detectors[levelDetectors[level]];
+        detector.setInputSize(levelSizes[level]);
+        result = detector.detect(image, confThreshold, iouThreshold, deadline);
+    }
+    catch (const DeadlineExceeded&)
+    {
+        missed = true;
+        stats.cancelled++;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    missed = missed || end > deadline; // NMS and scaling run after the last check
+    if (missed)
+        stats.misses++;
+
+    double elapsedUs = std::chrono::duration<double, std::micro>(end - start).count();
+    bool headroom = !missed && elapsedUs < policy.recoveryHeadroom * (double)budget.count();
+    this->updateLevel(missed, headroom);
+
+    lastMissed = missed;
+    return result;
+}
+
+/**
+ * @brief Fall back after repeated misses, go back up after a long run with headroom
+ * 
+ * @param missed The frame missed its deadline
+ * @param headroom The frame finished well within its budget
+*/
+void DeadlineDetector::updateLevel(const bool& missed, const bool& headroom)
+{
+    missStreak = missed ? missStreak + 1 : 0;
+    hitStreak = headroom ? hitStreak + 1 : 0;
+
+    if (missStreak >= policy.missesBeforeFallback && level + 1 < levelDetectors.size())
+    {
+        level++;
+        stats.fallbacks++;
+        missStreak = 0;
+        hitStreak = 0;
+        std::cout << "Deadline missed " << policy.missesBeforeFallback
+                  << " times, falling back to level " << level << std::endl;
+    }
+    else if (hitStreak >= policy.hitsBeforeRecovery && level > 0)
+    {
+        level--;
+        stats.recoveries++;
+        missStreak = 0;
+        hitStreak = 0;
+        std::cout << "Recovered to level " << level << std::endl;
+    }
+}
+
+/**
+ * @brief Reset the counters, the current level is kept
+*/
+void DeadlineDetector::resetStats()
+{
+    stats = DeadlineStats();
+    stats.levelFrames.assign(levelDetectors.size(), 0);
+}
+
+/**
+ * @brief Print the miss rate and the frames run on each level
+ * 
+ * @param os Output stream
+ */
+void DeadlineDetector::printStats(std::ostream& os) const
+{
+    os << "Deadline frames: " << stats.frames << std::endl;
+    os << "Miss rate: " << stats.missRate() * 100.0 << "%"
+       << " (" << stats.cancelled << " cancelled, " << stats.misses - stats.cancelled << " late)" << std::endl;
+    os << "Fallbacks: " << stats.fallbacks << ", recoveries: " << stats.recoveries
+       << ", current level: " << level << std::endl;
+    for (size_t i = 0; i < stats.levelFrames.size(); i++)
+        os << "Level " << i << ": " << stats.levelFrames[i] << " frames" << std::endl;
+}
@@ -1,5 +1,8 @@
 #include "detector.h"
 
+#include <cstdlib>
+#include <sstream>
+
 /**
  * @brief Construct a new YOLODetector::YOLODetector object
  * 
@@ -10,33 +13,119 @@
 YOLODetector::YOLODetector(const std::string& modelPath,
                            const bool& isGPU = true,
                            const cv::Size& inputSize = cv::Size(640, 640))
+    : YOLODetector(modelPath, isGPU, inputSize, DetectorOptions())
+{
+}
+
+/**
+ * @brief Construct a new YOLODetector::YOLODetector object
+ * 
+ * @param modelPath Path to the onnx model
+ * @param isGPU Inference on GPU
+ * @param inputSize Input size of the model
+ * @param options Memory and placement options of the session
+*/
+YOLODetector::YOLODetector(const std::string& modelPath,
+                           const bool& isGPU,
+                           const cv::Size& inputSize,
+                           const DetectorOptions& options)
 {
-    env = Ort::Env(OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, "CAR_DETECTION");
+    if (options.useSharedEnv)
+        this->sharedEnv = YOLODetector::getSharedEnv(options.sharedEnv);
+    else
+        env = Ort::Env(OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, "CAR_DETECTION");
+    Ort::Env& sessionEnv = this->sharedEnv ? *this->sharedEnv : env;
+
     sessionOptions = Ort::SessionOptions();
 
+    this->memoryOptions = options.memory;
+    if (!memoryOptions.enableCpuArena)
+    {
+        sessionOptions.DisableCpuMemArena();
+    }
+    else if (memoryOptions.useCustomArena)
+    {
+        // sessions only use an arena registered on the Env when asked to,
+        // on the shared Env the first detector asking for one registers it for all of them
+        if (this->sharedEnv)
+        {
+            YOLODetector::registerSharedArena(this->sharedEnv, memoryOptions);
+        }
+        else
+        {
+            Ort::MemoryInfo arenaMemoryInfo = Ort::MemoryInfo::CreateCpu(
+                    OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+            Ort::ArenaCfg arenaCfg(memoryOptions.arenaMaxMemory, memoryOptions.arenaExtendStrategy,
+                                   memoryOptions.initialChunkSizeBytes, memoryOptions.maxDeadBytesPerChunk);
+            sessionEnv.CreateAndRegisterAllocator(arenaMemoryInfo, arenaCfg);
+        }
+        sessionOptions.AddConfigEntry("session.use_env_allocators", "1");
+    }
+    if (!memoryOptions.enableMemPattern)
+        sessionOptions.DisableMemPattern();
+
+    const PlacementOptions& placement = options.placement;
+    std::vector<int> cpus = placement.numaNode >= 0 ? utils::getNumaNodeCpus(placement.numaNode)
+                                                    : placement.cpus;
+    if (this->sharedEnv)
+    {
+        // the session runs on the global pools of the Env, see SharedEnvOptions
+        sessionOptions.DisablePerSessionThreads();
+    }
+    else if (!cpus.empty())
+    {
+        std::cout << "Pinned to " << cpus.size() << " cpus" << std::endl;
+
+        // ORT creates its intra-op threads through createPinnedThread
+        this->placementCpus = std::make_shared<std::vector<int>>(cpus);
+        sessionOptions.SetIntraOpNumThreads(placement.intraOpThreads > 0 ? placement.intraOpThreads
+                                                                         : (int)cpus.size());
+        sessionOptions.SetCustomCreateThreadFn(YOLODetector::createPinnedThread);
+        sessionOptions.SetCustomThreadCreationOptions(this->placementCpus.get());
+        sessionOptions.SetCustomJoinThreadFn(YOLODetector::joinPinnedThread);
+    }
+    else if (placement.intraOpThreads > 0)
+    {
+        sessionOptions.SetIntraOpNumThreads(placement.intraOpThreads);
+    }
+
+    if (!cpus.empty() && placement.preprocessThreads > 0)
+        this->preprocessPool = std::make_shared<ThreadPool>(placement.preprocessThreads, cpus);
+
     std::vector<std::string> availableProviders = Ort::GetAvailableProviders();
     auto cudaAvailable = std::find(availableProviders.begin(), 
                                    availableProviders.end(), 
                                    "CUDAExecutionProvider"); // find the CUDAExecutionProvider
     OrtCUDAProviderOptions cudaOption;
 
+    bool useCpuProvider = true;
     if (isGPU && (cudaAvailable == availableProviders.end())){
         std::cout << "Inference device: CPU" << std::endl;
     }
     else if (isGPU && (cudaAvailable != availableProviders.end())){
         std::cout << "Inference device: GPU" << std::endl;
         sessionOptions.AppendExecutionProvider_CUDA(cudaOption);
+        useCpuProvider = false;
     }
     else{
         std::cout << "Inference device: CPU" << std::endl;
     }
 
-#ifdef _WIN32
-    std::wstring w_modelPath = utils::charToWstring(modelPath.c_str()); // exchange the modelPath to w_modelPath
-    session = Ort::Session(env, w_modelPath.c_str(), sessionOptions); // create the session
-#else
-    session = Ort::Session(env, modelPath.c_str(), sessionOptions);
-#endif
+    if (useCpuProvider)
+    {
+        ExecutionProvider provider = options.provider;
+        if (provider == ExecutionProvider::Auto)
+            provider = this->selectProvider(sessionEnv, modelPath, inputSize, options);
+
+        if (!utils::appendExecutionProvider(sessionOptions, provider, placement.intraOpThreads))
+        {
+            std::cout << utils::providerName(provider) << " is not available in this build" << std::endl;
+            provider = ExecutionProvider::CPU;
+        }
+        std::cout << "Execution provider: " << utils::providerName(provider) << std::endl;
+    }
+
+    session = YOLODetector::createSession(sessionEnv, modelPath, sessionOptions);
 
     Ort::AllocatorWithDefaultOptions allocator;
 
@@ -50,196 +139,1939 @@ YOLODetector::YOLODetector(const std::string& modelPath,
         this->isDynamicInputShape = true;
     }
 
+    this->isDynamicBatch = inputTensorShape[0] == -1;
+
     for (auto shape : inputTensorShape)
         std::cout << "Input shape: " << shape << std::endl;
 
-    inputNames.push_back(session.GetInputName(0, allocator));
-    outputNames.push_back(session.GetOutputName(0, allocator));
+    // the names are copied, the allocator's strings would otherwise stay alive with the process
+    auto takeName = [&allocator](char* name) {
+        std::string copy(name);
+        allocator.Free(name);
+        return copy;
+    };
+
+    this->inputNameStorage.push_back(takeName(session.GetInputName(0, allocator)));
+
+    // [1, N, 5 + C] is decoded in the graph, otherwise the model exports the raw detection heads
+    Ort::TypeInfo outputTypeInfo = session.GetOutputTypeInfo(0);
+    std::vector<int64_t> outputTensorShape = outputTypeInfo.GetTensorTypeAndShapeInfo().GetShape();
+    std::string firstOutputName = takeName(session.GetOutputName(0, allocator));
+    if (firstOutputName == "filtered_detections")
+    {
+        // filtered in the graph, only the kept candidates are returned
+        std::cout << "Filtered output layout" << std::endl;
+        this->outputLayout = OutputLayout::Filtered;
+        this->outputNameStorage.push_back(firstOutputName);
+
+        // the rows only carry class ids, the class count is stored by the augmentation tool
+        char* numClasses = session.GetModelMetadata().LookupCustomMetadataMap("num_classes", allocator);
+        if (numClasses != nullptr)
+        {
+            this->filteredNumClasses = std::max(0, std::atoi(numClasses));
+            allocator.Free(numClasses);
+        }
+        if (this->filteredNumClasses <= 0)
+            std::cout << "No num_classes metadata, re-run tools/augment_postprocess.py" << std::endl;
+    }
+    else if (outputTensorShape.size() == 3)
+    {
+        // [1, 4 + C, N] has far fewer channels than anchors, a dynamic N is always the last axis
+        bool transposed = outputTensorShape[2] == -1 ||
+                          (outputTensorShape[1] != -1 && outputTensorShape[1] < outputTensorShape[2]);
+        if (transposed)
+            std::cout << "Transposed output layout" << std::endl;
+
+        this->outputLayout = transposed ? OutputLayout::Transposed : OutputLayout::Concatenated;
+        this->outputNameStorage.push_back(firstOutputName);
+
+        // pick a decoder compiled for the class count, see decodeRowsFixed()
+        int numClasses = (int)outputTensorShape[2] - 5;
+        if (!transposed && (numClasses == 1 || numClasses == 2 || numClasses == 80))
+            this->fixedNumClasses = numClasses;
+    }
+    else
+    {
+        std::cout << "Raw detection head outputs" << std::endl;
+        this->outputLayout = OutputLayout::RawHeads;
+        this->outputNameStorage.push_back(firstOutputName);
+        for (size_t i = 1; i < session.GetOutputCount(); i++)
+            this->outputNameStorage.push_back(takeName(session.GetOutputName(i, allocator)));
+    }
+
+    for (const std::string& name : this->inputNameStorage)
+        inputNames.push_back(name.c_str());
+    for (const std::string& name : this->outputNameStorage)
+        outputNames.push_back(name.c_str());
 
     std::cout << "Input name: " << inputNames[0] << std::endl;
-    std::cout << "Output name: " << outputNames[0] << std::endl;
+    for (const char* outputName : outputNames)
+        std::cout << "Output name: " << outputName << std::endl;
 
     this->inputImageShape = cv::Size2f(inputSize);
 }
 
 /**
- * @brief Get the Best Class Info object
+ * @brief Create a session from a model file
  * 
- * @param it iterator
- * @param numClasses The number of classes
- * @param bestConf The best confidence
- * @param bestClassId The best class id
- */
-void YOLODetector::getBestClassInfo(std::vector<float>::iterator it, const int& numClasses,
-                                    float& bestConf, int& bestClassId)
+ * @param env Env of the session
+ * @param modelPath Path to the onnx model
+ * @param sessionOptions Session options
+ * @return Ort::Session 
+*/
+Ort::Session YOLODetector::createSession(Ort::Env& env, const std::string& modelPath,
+                                         const Ort::SessionOptions& sessionOptions)
 {
-    // first 5 element are box and obj confidence
-    bestClassId = 5;
-    bestConf = 0;
+#ifdef _WIN32
+    std::wstring w_modelPath = utils::charToWstring(modelPath.c_str()); // exchange the modelPath to w_modelPath
+    return Ort::Session(env, w_modelPath.c_str(), sessionOptions); // create the session
+#else
+    return Ort::Session(env, modelPath.c_str(), sessionOptions);
+#endif
+}
 
-    for (int i = 5; i < numClasses + 5; i++)
+/**
+ * @brief Pick the fastest CPU provider for the model on this machine
+ * 
+ * Every provider available in the linked ORT build is timed on the model and
+ * input shape. The choice is cached per model hash, input size and intra-op
+ * thread count, so later starts on the same machine skip the benchmark. A cached
+ * provider missing from the linked ORT build is benchmarked again.
+ * 
+ * @param env Env of the candidate sessions
+ * @param modelPath Path to the onnx model
+ * @param inputSize Input size of the model
+ * @param options Detector options, for the thread count and the cache path
+ * @return ExecutionProvider 
+*/
+ExecutionProvider YOLODetector::selectProvider(Ort::Env& env, const std::string& modelPath,
+                                               const cv::Size& inputSize, const DetectorOptions& options) const
+{
+    // the threads the session runs with, ORT picks one per core when not set
+    int numThreads = options.placement.intraOpThreads > 0 ? options.placement.intraOpThreads
+                                                          : (int)std::thread::hardware_concurrency();
+    std::ostringstream key;
+    key << std::hex << utils::hashFile(modelPath) << std::dec
+        << "_" << inputSize.width << "x" << inputSize.height
+        << "_" << numThreads;
+
+    std::vector<ExecutionProvider> available = utils::getAvailableCpuProviders();
+    ExecutionProvider provider = ExecutionProvider::CPU;
+    if (utils::loadCachedProvider(options.providerCachePath, key.str(), provider))
     {
-        if (it[i] > bestConf)
+        if (std::find(available.begin(), available.end(), provider) != available.end())
         {
-            bestConf = it[i];
-            bestClassId = i - 5;
+            std::cout << "Cached execution provider: " << utils::providerName(provider) << std::endl;
+            return provider;
+        }
+        std::cout << "Cached " << utils::providerName(provider) << " is not available in this build" << std::endl;
+        provider = ExecutionProvider::CPU;
+    }
+
+    double bestMs = std::numeric_limits<double>::infinity();
+    for (ExecutionProvider candidate : available)
+    {
+        double ms = this->timeProvider(env, modelPath, inputSize, candidate, options.placement.intraOpThreads);
+        std::cout << utils::providerName(candidate) << ": " << ms << " ms" << std::endl;
+        if (ms < bestMs)
+        {
+            bestMs = ms;
+            provider = candidate;
         }
     }
 
+    utils::storeCachedProvider(options.providerCachePath, key.str(), provider);
+    return provider;
 }
 
 /**
- * @brief Preprocess the image
+ * @brief Median latency of a provider on the model
  * 
- * @param image Input image
- * @param blob Pointer to the blob
- * @param inputTensorShape Input tensor shape
+ * @param env Env of the candidate session
+ * @param modelPath Path to the onnx model
+ * @param inputSize Input size used for the dynamic axes
+ * @param provider Execution provider
+ * @param numThreads Threads of the provider's own pool, 0: its default
+ * @return double Milliseconds per run, infinity if the provider fails on the model
 */
-void YOLODetector::preprocessing(cv::Mat &image, float*& blob, std::vector<int64_t>& inputTensorShape)
+double YOLODetector::timeProvider(Ort::Env& env, const std::string& modelPath, const cv::Size& inputSize,
+                                  const ExecutionProvider& provider, const int& numThreads) const
 {
-    cv::Mat resizedImage, floatImage;
-    cv::cvtColor(image, resizedImage, cv::COLOR_BGR2RGB); // convert to RGB
-    utils::letterbox(resizedImage, resizedImage, this->inputImageShape,
-                     cv::Scalar(114, 114, 114), this->isDynamicInputShape,
-                     false, true, 32);
+    const int warmupRuns = 2;
+    const int timedRuns = 5;
+
+    try
+    {
+        // same arena, memory pattern and threading settings as the real session
+        Ort::SessionOptions candidateOptions = this->sessionOptions.Clone();
+        if (!utils::appendExecutionProvider(candidateOptions, provider, numThreads))
+            return std::numeric_limits<double>::infinity();
+        Ort::Session candidate = YOLODetector::createSession(env, modelPath, candidateOptions);
+
+        std::vector<int64_t> shape = candidate.GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        shape[0] = 1;
+        if (shape[2] == -1)
+            shape[2] = inputSize.height;
+        if (shape[3] == -1)
+            shape[3] = inputSize.width;
+        std::vector<float> input(utils::vectorProduct(shape), 0.0f);
+
+        Ort::AllocatorWithDefaultOptions allocator;
+        std::vector<std::string> nameStorage;
+        auto takeName = [&allocator, &nameStorage](char* name) {
+            nameStorage.emplace_back(name);
+            allocator.Free(name);
+        };
+        takeName(candidate.GetInputName(0, allocator));
+        for (size_t i = 0; i < candidate.GetOutputCount(); i++)
+            takeName(candidate.GetOutputName(i, allocator));
 
-    inputTensorShape[2] = resizedImage.rows;
-    inputTensorShape[3] = resizedImage.cols;
+        std::vector<const char*> names;
+        for (const std::string& name : nameStorage)
+            names.push_back(name.c_str());
 
-    resizedImage.convertTo(floatImage, CV_32FC3, 1 / 255.0); // convert to float
-    blob = new float[floatImage.cols * floatImage.rows * floatImage.channels()];
-    cv::Size floatImageSize {floatImage.cols, floatImage.rows};
+        Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
+                OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+        Ort::Value inputTensor = Ort::Value::CreateTensor<float>(
+                memoryInfo, input.data(), input.size(), shape.data(), shape.size());
 
-    // convert HWC to CHW
-    std::vector<cv::Mat> chw(floatImage.channels());
-    for (int i = 0; i < floatImage.channels(); ++i)
+        std::vector<double> times;
+        for (int i = 0; i < warmupRuns + timedRuns; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            candidate.Run(Ort::RunOptions{nullptr}, names.data(), &inputTensor, 1,
+                          names.data() + 1, names.size() - 1);
+            auto end = std::chrono::steady_clock::now();
+            if (i >= warmupRuns)
+                times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+
+        std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+        return times[times.size() / 2];
+    }
+    catch (const Ort::Exception& e)
     {
-        chw[i] = cv::Mat(floatImageSize, CV_32FC1, blob + i * floatImageSize.width * floatImageSize.height);
+        std::cout << utils::providerName(provider) << " failed: " << e.what() << std::endl;
+        return std::numeric_limits<double>::infinity();
     }
-    cv::split(floatImage, chw); // split the image into channels
 }
 
 /**
- * @brief Postprocess the output
+ * @brief Get the process-wide Env, creating it with global thread pools if needed
  * 
- * @param resizedImageShape Resized image shape
- * @param originalImageShape Original image shape
- * @param outputTensors Output tensors
- * @param confThreshold Confidence threshold
- * @param iouThreshold IOU threshold
- * @return std::vector<Detection> 
+ * Detectors on the shared Env disable their per-session threads, so several
+ * models in one process share one intra-op pool instead of each spawning a
+ * thread per core. The Env lives as long as one detector holds it.
+ * 
+ * @param options Thread pools of the Env, ignored when it already exists
+ * @return std::shared_ptr<Ort::Env> 
 */
-std::vector<Detection> YOLODetector::postprocessing(const cv::Size& resizedImageShape,
-                                                    const cv::Size& originalImageShape,
-                                                    std::vector<Ort::Value>& outputTensors,
-                                                    const float& confThreshold, const float& iouThreshold)
+std::shared_ptr<Ort::Env> YOLODetector::getSharedEnv(const SharedEnvOptions& options)
 {
-    std::vector<cv::Rect> boxes;
-    std::vector<float> confs;
-    std::vector<int> classIds;
+    static std::mutex mutex;
+    static std::weak_ptr<Ort::Env> instance;
+    static std::vector<int> cpus; // read by createPinnedThread while the pools start
 
-    auto* rawOutput = outputTensors[0].GetTensorData<float>(); // get the output tensor
-    std::vector<int64_t> outputShape = outputTensors[0].GetTensorTypeAndShapeInfo().GetShape(); // get the output shape
-    size_t count = outputTensors[0].GetTensorTypeAndShapeInfo().GetElementCount(); // get the number of elements in the output tensor
-    std::vector<float> output(rawOutput, rawOutput + count); // convert the output tensor to vector
+    std::lock_guard<std::mutex> lock(mutex);
 
-    // for (const int64_t& shape : outputShape)
-    //     std::cout << "Output Shape: " << shape << std::endl;
+    std::shared_ptr<Ort::Env> env = instance.lock();
+    if (env)
+        return env;
 
-    // first 5 elements are box[4] and obj confidence
-    int numClasses = (int)outputShape[2] - 5;
-    int elementsInBatch = (int)(outputShape[1] * outputShape[2]);
+    Ort::ThreadingOptions threadingOptions;
+    if (options.intraOpThreads > 0)
+        threadingOptions.SetGlobalIntraOpNumThreads(options.intraOpThreads);
+    if (options.interOpThreads > 0)
+        threadingOptions.SetGlobalInterOpNumThreads(options.interOpThreads);
+    threadingOptions.SetGlobalSpinControl(options.allowSpinning ? 1 : 0);
+    if (!options.cpus.empty())
+    {
+        cpus = options.cpus;
+        threadingOptions.SetGlobalCustomCreateThreadFn(YOLODetector::createPinnedThread);
+        threadingOptions.SetGlobalCustomThreadCreationOptions(&cpus);
+        threadingOptions.SetGlobalCustomJoinThreadFn(YOLODetector::joinPinnedThread);
+    }
 
-    // only for batch size = 1
-    for (auto it = output.begin(); it != output.begin() + elementsInBatch; it += outputShape[2])
+    std::cout << "Shared Env with global thread pools" << std::endl;
+    env = std::make_shared<Ort::Env>(threadingOptions, OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING,
+                                     "CAR_DETECTION");
+    instance = env;
+
+    return env;
+}
+
+/**
+ * @brief Register the custom arena of the options on the shared Env, once per Env
+ * 
+ * The Env holds a single CPU arena, so a detector asking for other settings
+ * than the first one keeps the registered arena and says so.
+ * 
+ * @param env The shared Env
+ * @param options Memory options with useCustomArena set
+*/
+void YOLODetector::registerSharedArena(const std::shared_ptr<Ort::Env>& env, const MemoryOptions& options)
+{
+    static std::mutex mutex;
+    static std::weak_ptr<Ort::Env> registeredEnv;
+    static MemoryOptions registered;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (registeredEnv.lock() != env)
     {
-        float clsConf = it[4]; // object confidence
+        Ort::MemoryInfo arenaMemoryInfo = Ort::MemoryInfo::CreateCpu(
+                OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+        Ort::ArenaCfg arenaCfg(options.arenaMaxMemory, options.arenaExtendStrategy,
+                               options.initialChunkSizeBytes, options.maxDeadBytesPerChunk);
+        env->CreateAndRegisterAllocator(arenaMemoryInfo, arenaCfg);
+        registeredEnv = env;
+        registered = options;
+        return;
+    }
 
-        if (clsConf > confThreshold)
-        {
-            int centerX = (int) (it[0]);
-            int centerY = (int) (it[1]);
-            int width = (int) (it[2]);
-            int height = (int) (it[3]);
-            int left = centerX - width / 2;
-            int top = centerY - height / 2;
+    if (registered.arenaMaxMemory != options.arenaMaxMemory ||
+        registered.arenaExtendStrategy != options.arenaExtendStrategy ||
+        registered.initialChunkSizeBytes != options.initialChunkSizeBytes ||
+        registered.maxDeadBytesPerChunk != options.maxDeadBytesPerChunk)
+    {
+        std::cout << "The shared Env already has an arena with other settings, keeping it (max memory "
+                  << registered.arenaMaxMemory << ")" << std::endl;
+    }
+}
 
-            float objConf;
-            int classId;
-            this->getBestClassInfo(it, numClasses, objConf, classId); // get the best class info
+/**
+ * @brief Create an ORT intra-op thread pinned to the placement cpus
+ * 
+ * @param options Pointer to the cpu ids
+ * @param workerFn ORT worker loop
+ * @param workerParam Argument of the worker loop
+ * @return OrtCustomThreadHandle Owning pointer to the std::thread
+ */
+OrtCustomThreadHandle YOLODetector::createPinnedThread(void* options, OrtThreadWorkerFn workerFn,
+                                                       void* workerParam)
+{
+    std::vector<int> cpus = *static_cast<const std::vector<int>*>(options);
+
+    // pin before running the worker, so its first allocations are node-local
+    auto* thread = new std::thread([cpus, workerFn, workerParam]() {
+        utils::setThreadAffinity(cpus);
+        workerFn(workerParam);
+    });
+
+    return reinterpret_cast<OrtCustomThreadHandle>(thread);
+}
+
+/**
+ * @brief Join a thread of createPinnedThread
+ * 
+ * @param handle Thread handle
+ */
+void YOLODetector::joinPinnedThread(OrtCustomThreadHandle handle)
+{
+    auto* thread = reinterpret_cast<std::thread*>(const_cast<OrtCustomHandleType*>(handle));
+    thread->join();
+    delete thread;
+}
 
-            float confidence = clsConf * objConf; // confidence = object confidence * class confidence
+/**
+ * @brief Get the Best Class Info object
+ * 
+ * @param it Pointer to the first element of an output row
+ * @param numClasses The number of classes
+ * @param bestConf The best confidence
+ * @param bestClassId The best class id
+ */
+void YOLODetector::getBestClassInfo(const float* it, const int& numClasses,
+                                    float& bestConf, int& bestClassId)
+{
+    // first 5 element are box and obj confidence
+    bestClassId = 0;
+    bestConf = 0;
 
-            boxes.emplace_back(left, top, width, height);
-            confs.emplace_back(confidence);
-            classIds.emplace_back(classId);
+    for (int i = 5; i < numClasses + 5; i++)
+    {
+        if (it[i] > bestConf)
+        {
+            bestConf = it[i];
+            bestClassId = i - 5;
         }
     }
 
-    std::vector<int> indices;
-    cv::dnn::NMSBoxes(boxes, confs, confThreshold, iouThreshold, indices); // non-maximum suppression
-    // std::cout << "amount of NMS indices: " << indices.size() << std::endl;
+}
 
-    std::vector<Detection> detections;
+/**
+ * @brief Get the Best Class Info object for a class count known at compile time
+ * 
+ * The max is reduced over 4 independent lanes of a fixed-length loop, which the
+ * compiler fully unrolls and vectorizes, then the first class reaching it is
+ * looked up. Ties resolve to the lowest class id, as in getBestClassInfo().
+ * 
+ * @param it Pointer to the first element of an output row
+ * @param bestConf The best confidence
+ * @param bestClassId The best class id
+ */
+template <int NumClasses>
+void YOLODetector::getBestClassInfoFixed(const float* it, float& bestConf, int& bestClassId)
+{
+    const float* scores = it + 5; // first 5 element are box and obj confidence
 
-    // get the detections
-    for (int idx : indices)
+    float lanes[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    const int vectorized = NumClasses - NumClasses % 4;
+    for (int i = 0; i < vectorized; i += 4)
     {
-        Detection det;
-        det.box = cv::Rect(boxes[idx]);
-        utils::scaleCoords(resizedImageShape, det.box, originalImageShape); // transform the coordinates to the original image
+        for (int lane = 0; lane < 4; lane++)
+            lanes[lane] = scores[i + lane] > lanes[lane] ? scores[i + lane] : lanes[lane];
+    }
+    for (int i = vectorized; i < NumClasses; i++)
+        lanes[0] = scores[i] > lanes[0] ? scores[i] : lanes[0];
 
-        det.conf = confs[idx];
-        det.classId = classIds[idx];
-        detections.emplace_back(det);
+    bestConf = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    bestClassId = 0;
+    for (int i = 0; i < NumClasses; i++)
+    {
+        if (scores[i] == bestConf)
+        {
+            bestClassId = i;
+            break;
+        }
     }
+}
 
-    return detections;
+template <>
+void YOLODetector::getBestClassInfoFixed<1>(const float* it, float& bestConf, int& bestClassId)
+{
+    bestConf = std::max(it[5], 0.0f);
+    bestClassId = 0;
+}
+
+template <>
+void YOLODetector::getBestClassInfoFixed<2>(const float* it, float& bestConf, int& bestClassId)
+{
+    bool second = it[6] > it[5];
+    bestConf = std::max(second ? it[6] : it[5], 0.0f);
+    bestClassId = second ? 1 : 0;
 }
 
 /**
- * @brief Detect objects in the image
+ * @brief Get the Best Class Info object, only looking at the given classes
  * 
- * @param image Input image
- * @param confThreshold Confidence threshold
- * @param iouThreshold IOU threshold
- * @return std::vector<Detection> 
-*/
-std::vector<Detection> YOLODetector::detect(cv::Mat &image, const float& confThreshold = 0.4,
-                                            const float& iouThreshold = 0.45)
+ * @param it Pointer to the first element of an output row
+ * @param classIds Classes taking part in the argmax
+ * @param bestConf The best confidence
+ * @param bestClassId The best class id
+ */
+void YOLODetector::getBestClassInfo(const float* it, const std::vector<int>& classIds,
+                                    float& bestConf, int& bestClassId)
 {
-    float *blob = nullptr;
-    std::vector<int64_t> inputTensorShape {1, 3, -1, -1}; // batch size, channels, height, width
-    this->preprocessing(image, blob, inputTensorShape);
+    bestClassId = classIds.empty() ? 0 : classIds[0];
+    bestConf = 0;
 
-    size_t inputTensorSize = utils::vectorProduct(inputTensorShape);
+    const float* scores = it + 5; // first 5 element are box and obj confidence
+    for (int classId : classIds)
+    {
+        if (scores[classId] > bestConf)
+        {
+            bestConf = scores[classId];
+            bestClassId = classId;
+        }
+    }
+}
 
-    std::vector<float> inputTensorValues(blob, blob + inputTensorSize);
+/**
+ * @brief Resolve the allowed classes and per-class thresholds for one decode
+ * 
+ * @param numClasses The number of classes of the model
+ * @param confThreshold Threshold of the classes without an override
+ * @param classes Allowed classes and per-class thresholds
+ * @return ClassFilter 
+ */
+YOLODetector::ClassFilter YOLODetector::makeClassFilter(const int& numClasses, const float& confThreshold,
+                                                        const ClassSelection& classes)
+{
+    ClassFilter filter;
+    filter.thresholds.assign(numClasses, confThreshold);
+    for (const auto& item : classes.classConfThresholds)
+    {
+        if (item.first >= 0 && item.first < numClasses)
+            filter.thresholds[item.first] = item.second;
+    }
 
-    std::vector<Ort::Value> inputTensors;
+    for (int classId : classes.allowedClassIds)
+    {
+        if (classId >= 0 && classId < numClasses)
+            filter.classIds.push_back(classId);
+    }
 
-    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
-            OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+    // class confidence <= 1, so a row needs at least the lowest threshold
+    // of the remaining classes as objectness
+    filter.minThreshold = 1.0f;
+    if (classes.allowedClassIds.empty())
+    {
+        for (float threshold : filter.thresholds)
+            filter.minThreshold = std::min(filter.minThreshold, threshold);
+    }
+    else
+    {
+        for (int classId : filter.classIds)
+            filter.minThreshold = std::min(filter.minThreshold, filter.thresholds[classId]);
+    }
 
-    inputTensors.push_back(Ort::Value::CreateTensor<float>(
-            memoryInfo, inputTensorValues.data(), inputTensorSize,
-            inputTensorShape.data(), inputTensorShape.size()
-    )); // create input tensor object from data values
+    return filter;
+}
 
-    std::vector<Ort::Value> outputTensors = this->session.Run(Ort::RunOptions{nullptr},
-                                                              inputNames.data(),
-                                                              inputTensors.data(),
-                                                              1,
-                                                              outputNames.data(),
-                                                              1); // run the model
+/**
+ * @brief Score one output row against the class filter
+ * 
+ * @param it Pointer to the first element of an output row
+ * @param numClasses The number of classes
+ * @param filter Class filter of this decode
+ * @param confidence Object confidence * class confidence
+ * @param classId The best allowed class id
+ * @return true if the row passes the threshold of its class
+ */
+bool YOLODetector::scoreRow(const float* it, const int& numClasses, const ClassFilter& filter,
+                            float& confidence, int& classId)
+{
+    float objConf = it[4]; // object confidence
+    if (objConf <= filter.minThreshold)
+        return false;
 
-    cv::Size resizedShape = cv::Size((int)inputTensorShape[3], (int)inputTensorShape[2]); // get the resized image shape
-    std::vector<Detection> result = this->postprocessing(resizedShape,
-                                                         image.size(),
-                                                         outputTensors,
-                                                         confThreshold, iouThreshold);
+    float clsConf;
+    if (filter.classIds.empty())
+        getBestClassInfo(it, numClasses, clsConf, classId);
+    else
+        getBestClassInfo(it, filter.classIds, clsConf, classId);
 
-    delete[] blob;
+    confidence = objConf * clsConf; // confidence = object confidence * class confidence
 
-    return result;
+    return confidence > filter.thresholds[classId];
+}
+
+/**
+ * @brief Get the box of an output row
+ * 
+ * @param it Pointer to the first element of an output row (cx, cy, w, h)
+ * @return cv::Rect Box in the resized image
+ */
+cv::Rect YOLODetector::getBox(const float* it)
+{
+    return getBox(it[0], it[1], it[2], it[3]);
+}
+
+/**
+ * @brief Get the box from its center and size
+ * 
+ * @param centerX Center x in the resized image
+ * @param centerY Center y in the resized image
+ * @param width Box width
+ * @param height Box height
+ * @return cv::Rect Box in the resized image
+ */
+cv::Rect YOLODetector::getBox(const float& centerX, const float& centerY,
+                              const float& width, const float& height)
+{
+    int left = (int)centerX - (int)width / 2;
+    int top = (int)centerY - (int)height / 2;
+
+    return cv::Rect(left, top, (int)width, (int)height);
+}
+
+/**
+ * @brief Transform a box from the resized image to the original image
+ * 
+ * Uses the letterbox plan of the preprocessing, so the exact padding is used
+ * also when only padding to a stride multiple.
+ * 
+ * @param box Box in the resized image
+ * @param plan Letterbox plan the image was preprocessed with
+ * @param resizedImageShape Resized image shape
+ * @param originalImageShape Original image shape
+ * @return cv::Rect Box in the original image
+ */
+cv::Rect YOLODetector::scaleBox(const cv::Rect& box, const utils::LetterboxPlan& plan,
+                                const cv::Size& resizedImageShape, const cv::Size& originalImageShape)
+{
+    if (plan.inputShape() == originalImageShape && plan.outputShape() == resizedImageShape)
+        return plan.inverse(box);
+
+    cv::Rect coords = box;
+    utils::scaleCoords(resizedImageShape, coords, originalImageShape);
+    return coords;
+}
+
+/**
+ * @brief Decode the candidates of the output tensors into a sink
+ * 
+ * @param resizedImageShape Resized image shape
+ * @param outputTensors Output tensors
+ * @param confThreshold Confidence threshold
+ * @param classes Allowed classes and per-class thresholds
+ * @param sink CandidateList or BestCandidate
+ */
+template <typename Sink>
+void YOLODetector::decode(const cv::Size& resizedImageShape, std::vector<Ort::Value>& outputTensors,
+                          const float& confThreshold, const ClassSelection& classes, Sink& sink) const
+{
+    switch (this->outputLayout)
+    {
+    case OutputLayout::Transposed:
+        this->decodeTransposed(outputTensors, confThreshold, classes, sink);
+        break;
+    case OutputLayout::RawHeads:
+        this->decodeHeads(resizedImageShape, outputTensors, confThreshold, classes, sink);
+        break;
+    case OutputLayout::Filtered:
+        this->decodeFiltered(outputTensors, confThreshold, classes, sink);
+        break;
+    default:
+        this->decodeRows(outputTensors, confThreshold, classes, sink);
+        break;
+    }
+}
+
+/**
+ * @brief Decode rows [0, numRows) in chunks on decodeThreads workers
+ * 
+ * Chunks are sized to stay in L2 and each gets its own sink, so the workers
+ * share nothing. The chunk sinks are merged in row order afterwards, which
+ * gives the same candidates in the same order as a serial decode for any
+ * number of threads.
+ * 
+ * @param numRows Number of rows, or anchors
+ * @param rowBytes Bytes read per row
+ * @param sink CandidateList or BestCandidate
+ * @param decodeChunk Decodes the rows [begin, end) into the given sink
+ */
+template <typename Sink, typename DecodeChunk>
+void YOLODetector::decodeChunked(const size_t& numRows, const size_t& rowBytes, Sink& sink,
+                                 const DecodeChunk& decodeChunk) const
+{
+    const size_t chunkBytes = 256 * 1024;
+    size_t chunkRows = std::max<size_t>(1, chunkBytes / std::max<size_t>(rowBytes, 1) / 256) * 256;
+    size_t numChunks = (numRows + chunkRows - 1) / chunkRows;
+    if (this->decodeThreads <= 1 || numChunks <= 1)
+    {
+        decodeChunk(0, numRows, sink);
+        return;
+    }
+
+    std::vector<Sink> chunkSinks(numChunks);
+    int numTasks = (int)std::min<size_t>((size_t)this->decodeThreads, numChunks);
+    auto runTask = [&](const int& task) {
+        // chunks are interleaved over the tasks, which evens out the rows that pass the threshold
+        for (size_t chunk = task; chunk < numChunks; chunk += numTasks)
+            decodeChunk(chunk * chunkRows, std::min(numRows, (chunk + 1) * chunkRows), chunkSinks[chunk]);
+    };
+
+    if (this->preprocessPool)
+    {
+        this->preprocessPool->parallelFor(numTasks, runTask);
+    }
+    else
+    {
+        cv::parallel_for_(cv::Range(0, numTasks), [&](const cv::Range& range) {
+            for (int task = range.start; task < range.end; task++)
+                runTask(task);
+        }, numTasks);
+    }
+
+    for (const Sink& chunkSink : chunkSinks)
+        sink.merge(chunkSink);
+}
+
+/**
+ * @brief Decode a [1, N, 5 + C] output whose boxes are already decoded in the graph
+ * 
+ * @param outputTensors Output tensors
+ * @param confThreshold Confidence threshold
+ * @param classes Allowed classes and per-class thresholds
+ * @param sink CandidateList or BestCandidate
+ */
+template <typename Sink>
+void YOLODetector::decodeRows(std::vector<Ort::Value>& outputTensors, const float& confThreshold,
+                              const ClassSelection& classes, Sink& sink) const
+{
+    auto* rawOutput = outputTensors[0].GetTensorData<float>(); // get the output tensor
+    std::vector<int64_t> outputShape = outputTensors[0].GetTensorTypeAndShapeInfo().GetShape(); // get the output shape
+
+    // for (const int64_t& shape : outputShape)
+    //     std::cout << "Output Shape: " << shape << std::endl;
+
+    // first 5 elements are box[4] and obj confidence
+    int numClasses = (int)outputShape[2] - 5;
+    size_t numRows = (size_t)outputShape[1];
+    size_t rowSize = (size_t)outputShape[2];
+
+    ClassFilter filter = this->makeClassFilter(numClasses, confThreshold, classes);
+    if (filter.minThreshold >= 1.0f)
+        return; // no class can pass its threshold
+
+    // the specialized decoders scan all classes, so they are skipped for class subsets
+    bool isFixed = numClasses == this->fixedNumClasses && filter.classIds.empty();
+
+    // only for batch size = 1
+    this->decodeChunked(numRows, rowSize * sizeof(float), sink,
+                        [&](const size_t& begin, const size_t& end, Sink& chunkSink) {
+        const float* rows = rawOutput + begin * rowSize;
+        if (isFixed)
+        {
+            switch (this->fixedNumClasses)
+            {
+            case 1:
+                decodeRowsFixed<1>(rows, end - begin, filter, chunkSink);
+                return;
+            case 2:
+                decodeRowsFixed<2>(rows, end - begin, filter, chunkSink);
+                return;
+            case 80:
+                decodeRowsFixed<80>(rows, end - begin, filter, chunkSink);
+                return;
+            default:
+                break;
+            }
+        }
+
+        for (const float* it = rows; it != rawOutput + end * rowSize; it += rowSize)
+        {
+            // class confidence <= 1, so a row whose objectness does not beat
+            // the bound of the sink can never be kept
+            if (it[4] <= chunkSink.bound())
+                continue;
+
+            float confidence;
+            int classId;
+            if (this->scoreRow(it, numClasses, filter, confidence, classId))
+                chunkSink.add(this->getBox(it), confidence, classId);
+        }
+    });
+}
+
+/**
+ * @brief Decode a [1, N, 5 + NumClasses] output with the row stride known at compile time
+ * 
+ * @param rawOutput Pointer to the first row
+ * @param numRows Number of rows
+ * @param filter Class filter of this decode, without a class subset
+ * @param sink CandidateList or BestCandidate
+ */
+template <int NumClasses, typename Sink>
+void YOLODetector::decodeRowsFixed(const float* rawOutput, const size_t& numRows,
+                                   const ClassFilter& filter, Sink& sink)
+{
+    const int rowSize = 5 + NumClasses;
+
+    for (size_t row = 0; row < numRows; row++)
+    {
+        const float* it = rawOutput + row * rowSize;
+
+        float objConf = it[4]; // object confidence
+        if (objConf <= filter.minThreshold || objConf <= sink.bound())
+            continue;
+
+        float clsConf;
+        int classId;
+        getBestClassInfoFixed<NumClasses>(it, clsConf, classId);
+
+        float confidence = objConf * clsConf; // confidence = object confidence * class confidence
+        if (confidence > filter.thresholds[classId])
+            sink.add(getBox(it), confidence, classId);
+    }
+}
+
+/**
+ * @brief Decode a [1, 4 + C, N] output (YOLOv8/v11, no objectness) in place
+ * 
+ * Anchors are processed in blocks: each class channel is read as a contiguous
+ * run of the block and folded into the running maxima, so the tensor is
+ * streamed channel by channel without a transpose copy.
+ * 
+ * @param outputTensors Output tensors
+ * @param confThreshold Confidence threshold
+ * @param classes Allowed classes and per-class thresholds
+ * @param sink CandidateList or BestCandidate
+ */
+template <typename Sink>
+void YOLODetector::decodeTransposed(std::vector<Ort::Value>& outputTensors, const float& confThreshold,
+                                    const ClassSelection& classes, Sink& sink) const
+{
+    const int blockSize = 256; // anchors per block, keeps the running maxima in L1
+
+    auto* rawOutput = outputTensors[0].GetTensorData<float>(); // get the output tensor
+    std::vector<int64_t> outputShape = outputTensors[0].GetTensorTypeAndShapeInfo().GetShape(); // get the output shape
+
+    // first 4 channels are the box, then one channel per class
+    int numClasses = (int)outputShape[1] - 4;
+    int numAnchors = (int)outputShape[2];
+
+    ClassFilter filter = this->makeClassFilter(numClasses, confThreshold, classes);
+    if (filter.minThreshold >= 1.0f)
+        return; // no class can pass its threshold
+
+    std::vector<int> classIds = filter.classIds;
+    if (classIds.empty())
+    {
+        classIds.resize(numClasses);
+        for (int c = 0; c < numClasses; c++)
+            classIds[c] = c;
+    }
+
+    // chunks are multiples of blockSize, so the blocks of a serial decode are kept
+    this->decodeChunked((size_t)numAnchors, (size_t)(4 + numClasses) * sizeof(float), sink,
+                        [&](const size_t& begin, const size_t& end, Sink& chunkSink) {
+        float bestConfs[blockSize];
+        int bestClassIds[blockSize];
+
+        for (int start = (int)begin; start < (int)end; start += blockSize)
+        {
+            int count = std::min(blockSize, (int)end - start);
+
+            std::fill(bestConfs, bestConfs + count, 0.0f);
+            std::fill(bestClassIds, bestClassIds + count, classIds[0]);
+
+            for (int classId : classIds)
+            {
+                const float* scores = rawOutput + (size_t)(4 + classId) * numAnchors + start;
+                for (int j = 0; j < count; j++)
+                {
+                    if (scores[j] > bestConfs[j])
+                    {
+                        bestConfs[j] = scores[j];
+                        bestClassIds[j] = classId;
+                    }
+                }
+            }
+
+            for (int j = 0; j < count; j++)
+            {
+                float confidence = bestConfs[j];
+                if (confidence <= filter.thresholds[bestClassIds[j]] || confidence <= chunkSink.bound())
+                    continue;
+
+                size_t anchor = (size_t)start + j;
+                chunkSink.add(getBox(rawOutput[anchor],
+                                     rawOutput[numAnchors + anchor],
+                                     rawOutput[2 * (size_t)numAnchors + anchor],
+                                     rawOutput[3 * (size_t)numAnchors + anchor]),
+                              confidence, bestClassIds[j]);
+            }
+        }
+    });
+}
+
+/**
+ * @brief Decode the rows of a model augmented by tools/augment_postprocess.py
+ * 
+ * The graph already picked the best class of every row and dropped the rows
+ * below its own threshold, so only the class filter and thresholds are applied.
+ * 
+ * @param outputTensors Output tensors
+ * @param confThreshold Confidence threshold, below the one of the graph it has no effect
+ * @param classes Allowed classes and per-class thresholds
+ * @param sink Receives the candidates
+*/
+template <typename Sink>
+void YOLODetector::decodeFiltered(std::vector<Ort::Value>& outputTensors, const float& confThreshold,
+                                  const ClassSelection& classes, Sink& sink) const
+{
+    auto* rawOutput = outputTensors[0].GetTensorData<float>();
+    std::vector<int64_t> outputShape = outputTensors[0].GetTensorTypeAndShapeInfo().GetShape();
+    size_t numRows = (size_t)outputShape[1];
+
+    int numClasses = this->filteredNumClasses;
+    if (numClasses <= 0)
+    {
+        // models augmented without the metadata: large enough for the rows and every configured class,
+        // so no allowed class is dropped from the filter
+        for (size_t i = 0; i < numRows; i++)
+        {
+            float classId = rawOutput[i * 6 + 5];
+            if (classId >= 0.0f && classId < 65536.0f)
+                numClasses = std::max(numClasses, (int)classId + 1);
+        }
+        for (int classId : classes.allowedClassIds)
+            numClasses = std::max(numClasses, classId + 1);
+        for (const auto& item : classes.classConfThresholds)
+            numClasses = std::max(numClasses, item.first + 1);
+    }
+
+    ClassFilter filter = this->makeClassFilter(numClasses, confThreshold, classes);
+    if (filter.minThreshold >= 1.0f)
+        return; // no class can pass its threshold
+
+    for (const float* it = rawOutput; it != rawOutput + numRows * 6; it += 6)
+    {
+        float confidence = it[4];
+        // a NaN id fails both comparisons
+        if (!(it[5] >= 0.0f && it[5] < (float)numClasses))
+            continue;
+
+        int classId = (int)it[5];
+        if (confidence <= filter.thresholds[classId] || confidence <= sink.bound())
+            continue;
+        if (!filter.classIds.empty() &&
+            std::find(filter.classIds.begin(), filter.classIds.end(), classId) == filter.classIds.end())
+            continue;
+
+        sink.add(this->getBox(it), confidence, classId);
+    }
+}
+
+/**
+ * @brief Decode the raw detection heads with the grid and anchors (YOLOv5 v4.0+ decode)
+ * 
+ * Objectness logits are compared against logit(threshold), so only the rows
+ * that pass are decoded and go through the sigmoid.
+ * 
+ * @param resizedImageShape Resized image shape, gives the stride of each head
+ * @param outputTensors One output tensor per detection head
+ * @param confThreshold Confidence threshold
+ * @param classes Allowed classes and per-class thresholds
+ * @param sink CandidateList or BestCandidate
+ */
+template <typename Sink>
+void YOLODetector::decodeHeads(const cv::Size& resizedImageShape, std::vector<Ort::Value>& outputTensors,
+                               const float& confThreshold, const ClassSelection& classes, Sink& sink) const
+{
+    std::vector<std::vector<int64_t>> outputShapes;
+    for (const Ort::Value& output : outputTensors)
+        outputShapes.push_back(output.GetTensorTypeAndShapeInfo().GetShape());
+
+    // order the heads from the finest to the coarsest grid, as the anchors are
+    std::vector<size_t> order(outputTensors.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&outputShapes](size_t a, size_t b) {
+        return outputShapes[a][2] > outputShapes[b][2];
+    });
+
+    int numAnchors = (int)this->anchors[0].size() / 2;
+    const std::vector<int64_t>& firstShape = outputShapes[0];
+    int numOutputs = firstShape.size() == 5 ? (int)firstShape[4] : (int)firstShape[1] / numAnchors;
+    int numClasses = numOutputs - 5; // first 5 elements are box[4] and obj confidence
+
+    ClassFilter filter = this->makeClassFilter(numClasses, confThreshold, classes);
+    if (filter.minThreshold >= 1.0f)
+        return; // no class can pass its threshold
+
+    float objLogitThreshold = utils::logit(std::max(filter.minThreshold, sink.bound()));
+
+    for (size_t level = 0; level < order.size(); level++)
+    {
+        const std::vector<int64_t>& shape = outputShapes[order[level]];
+        const float* data = outputTensors[order[level]].GetTensorData<float>();
+        const std::vector<float>& levelAnchors = this->anchors[std::min(level, this->anchors.size() - 1)];
+
+        // [1, na, ny, nx, no] is channels last, [1, na * no, ny, nx] is channels first
+        bool channelsLast = shape.size() == 5;
+        int gridHeight = (int)shape[2];
+        int gridWidth = (int)shape[3];
+        size_t gridArea = (size_t)gridHeight * gridWidth;
+        size_t channelStride = channelsLast ? 1 : gridArea;
+        float strideX = (float)resizedImageShape.width / (float)gridWidth;
+        float strideY = (float)resizedImageShape.height / (float)gridHeight;
+
+        for (int a = 0; a < numAnchors; a++)
+        {
+            const float* anchorData = data + (size_t)a * numOutputs * gridArea;
+
+            for (int y = 0; y < gridHeight; y++)
+            {
+                for (int x = 0; x < gridWidth; x++)
+                {
+                    size_t cell = (size_t)y * gridWidth + x;
+                    const float* it = anchorData + (channelsLast ? cell * numOutputs : cell);
+
+                    float objLogit = it[4 * channelStride];
+                    if (objLogit <= objLogitThreshold)
+                        continue;
+
+                    // the sigmoid is monotonic, so the argmax is taken over the logits
+                    int classId = filter.classIds.empty() ? 0 : filter.classIds[0];
+                    float clsLogit = -std::numeric_limits<float>::infinity();
+                    if (filter.classIds.empty())
+                    {
+                        for (int c = 0; c < numClasses; c++)
+                        {
+                            if (it[(5 + c) * channelStride] > clsLogit)
+                            {
+                                clsLogit = it[(5 + c) * channelStride];
+                                classId = c;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        for (int c : filter.classIds)
+                        {
+                            if (it[(5 + c) * channelStride] > clsLogit)
+                            {
+                                clsLogit = it[(5 + c) * channelStride];
+                                classId = c;
+                            }
+                        }
+                    }
+
+                    float confidence = utils::sigmoid(objLogit) * utils::sigmoid(clsLogit);
+                    if (confidence <= filter.thresholds[classId] || confidence <= sink.bound())
+                        continue;
+
+                    float centerX = (utils::sigmoid(it[0]) * 2.0f - 0.5f + (float)x) * strideX;
+                    float centerY = (utils::sigmoid(it[channelStride]) * 2.0f - 0.5f + (float)y) * strideY;
+                    float width = utils::sigmoid(it[2 * channelStride]) * 2.0f;
+                    float height = utils::sigmoid(it[3 * channelStride]) * 2.0f;
+                    width = width * width * levelAnchors[2 * a];
+                    height = height * height * levelAnchors[2 * a + 1];
+
+                    sink.add(getBox(centerX, centerY, width, height), confidence, classId);
+                    objLogitThreshold = utils::logit(std::max(filter.minThreshold, sink.bound()));
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Preprocess the image
+ * 
+ * @param image Input image
+ * @param plan Letterbox plan, rebuilt when it does not match the image
+ * @param blob Blob, resized to the input tensor size
+ * @param inputTensorShape Input tensor shape
+*/
+void YOLODetector::preprocessing(const cv::Mat& image, utils::LetterboxPlan& plan, std::vector<float>& blob,
+                                 std::vector<int64_t>& inputTensorShape)
+{
+    cv::Size newShape = cv::Size(this->inputImageShape);
+    if (!plan.matches(image.size(), newShape, this->isDynamicInputShape, true, 32))
+        plan = utils::LetterboxPlan(image.size(), newShape, this->isDynamicInputShape, true, 32);
+
+    cv::Size resizedShape = plan.outputShape();
+    inputTensorShape[2] = resizedShape.height;
+    inputTensorShape[3] = resizedShape.width;
+
+    size_t blobSize = 3 * (size_t)resizedShape.width * resizedShape.height;
+    if (this->preprocessPool && blob.size() != blobSize)
+    {
+        // first touch on a pinned worker allocates the pages on its NUMA node
+        this->preprocessPool->enqueue([&blob, blobSize]() { blob.resize(blobSize); }).get();
+    }
+    else
+    {
+        blob.resize(blobSize);
+    }
+
+    // letterbox, convert to RGB, convert to float and HWC to CHW in one pass
+    if (this->preprocessPool)
+        plan.runParallel(image, blob.data(), cv::Scalar(114, 114, 114), *this->preprocessPool);
+    else
+        plan.runParallel(image, blob.data(), cv::Scalar(114, 114, 114), this->preprocessThreads);
+}
+
+/**
+ * @brief Postprocess the output
+ * 
+ * @param plan Letterbox plan the image was preprocessed with
+ * @param resizedImageShape Resized image shape
+ * @param originalImageShape Original image shape
+ * @param outputTensors Output tensors
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @param classes Allowed classes and per-class thresholds
+ * @return std::vector<Detection> 
+*/
+std::vector<Detection> YOLODetector::postprocessing(const utils::LetterboxPlan& plan,
+                                                    const cv::Size& resizedImageShape,
+                                                    const cv::Size& originalImageShape,
+                                                    std::vector<Ort::Value>& outputTensors,
+                                                    const float& confThreshold, const float& iouThreshold,
+                                                    const ClassSelection& classes)
+{
+    CandidateList candidates;
+    this->decode(resizedImageShape, outputTensors, confThreshold, classes, candidates);
+    this->checkDeadline("decode");
+
+    // candidates already passed the threshold of their class
+    std::vector<int> indices;
+    cv::dnn::NMSBoxes(candidates.boxes, candidates.confs, 0.0f, iouThreshold, indices); // non-maximum suppression
+    // std::cout << "amount of NMS indices: " << indices.size() << std::endl;
+
+    std::vector<Detection> detections;
+
+    // get the detections
+    for (int idx : indices)
+    {
+        Detection det;
+        det.box = cv::Rect(candidates.boxes[idx]);
+        det.box = YOLODetector::scaleBox(det.box, plan, resizedImageShape, originalImageShape); // transform the coordinates to the original image
+
+        det.conf = candidates.confs[idx];
+        det.classId = candidates.classIds[idx];
+        detections.emplace_back(det);
+    }
+
+    return detections;
+}
+
+/**
+ * @brief Postprocess the output, keeping only the k most confident detections
+ * 
+ * For k = 1 the arg-max row is tracked during the decode, so no candidate
+ * vectors are built and NMS is skipped. For k > 1 the candidates are kept in
+ * a heap and suppressed lazily, stopping as soon as k boxes are accepted.
+ * 
+ * @param plan Letterbox plan the image was preprocessed with
+ * @param resizedImageShape Resized image shape
+ * @param originalImageShape Original image shape
+ * @param outputTensors Output tensors
+ * @param k Maximum number of detections to return
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @param classes Allowed classes and per-class thresholds
+ * @return std::vector<Detection> Detections sorted by descending confidence
+*/
+std::vector<Detection> YOLODetector::postprocessingTopK(const utils::LetterboxPlan& plan,
+                                                        const cv::Size& resizedImageShape,
+                                                        const cv::Size& originalImageShape,
+                                                        std::vector<Ort::Value>& outputTensors,
+                                                        const int& k,
+                                                        const float& confThreshold, const float& iouThreshold,
+                                                        const ClassSelection& classes)
+{
+    std::vector<Detection> detections;
+    if (k <= 0)
+        return detections;
+
+    if (k == 1)
+    {
+        BestCandidate best;
+        this->decode(resizedImageShape, outputTensors, confThreshold, classes, best);
+        this->checkDeadline("decode");
+        if (best.classId < 0)
+            return detections;
+
+        Detection det;
+        det.box = best.box;
+        det.box = YOLODetector::scaleBox(det.box, plan, resizedImageShape, originalImageShape);
+        det.conf = best.conf;
+        det.classId = best.classId;
+        detections.emplace_back(det);
+
+        return detections;
+    }
+
+    CandidateList candidates;
+    this->decode(resizedImageShape, outputTensors, confThreshold, classes, candidates);
+    this->checkDeadline("decode");
+
+    // (confidence, index into candidates)
+    struct Candidate
+    {
+        float conf;
+        int index;
+
+        bool operator<(const Candidate& other) const
+        {
+            // lower index wins ties, so the result is stable
+            return conf < other.conf || (conf == other.conf && index > other.index);
+        }
+    };
+
+    std::vector<Candidate> heap;
+    heap.reserve(candidates.confs.size());
+    for (size_t i = 0; i < candidates.confs.size(); i++)
+        heap.push_back({candidates.confs[i], (int)i});
+    std::make_heap(heap.begin(), heap.end());
+
+    std::vector<cv::Rect> keptBoxes;
+    while (!heap.empty() && (int)detections.size() < k)
+    {
+        std::pop_heap(heap.begin(), heap.end());
+        Candidate candidate = heap.back();
+        heap.pop_back();
+
+        const cv::Rect& box = candidates.boxes[candidate.index];
+
+        bool suppressed = false;
+        for (const cv::Rect& kept : keptBoxes)
+        {
+            if (utils::computeIoU(box, kept) > iouThreshold)
+            {
+                suppressed = true;
+                break;
+            }
+        }
+        if (suppressed)
+            continue;
+
+        keptBoxes.push_back(box);
+
+        Detection det;
+        det.box = box;
+        det.box = YOLODetector::scaleBox(det.box, plan, resizedImageShape, originalImageShape);
+        det.conf = candidate.conf;
+        det.classId = candidates.classIds[candidate.index];
+        detections.emplace_back(det);
+    }
+
+    return detections;
+}
+
+/**
+ * @brief Preprocess the image and run the model
+ * 
+ * @param image Input image
+ * @param buffers Letterbox plan and blob of the call, the blob must outlive the output tensors' use of the input
+ * @param resizedImageShape Filled with the shape of the model input
+ * @return std::vector<Ort::Value> Output tensors
+*/
+std::vector<Ort::Value> YOLODetector::inference(cv::Mat &image, InputBuffers& buffers, cv::Size& resizedImageShape)
+{
+    std::vector<int64_t> inputTensorShape {1, 3, -1, -1}; // batch size, channels, height, width
+    this->checkDeadline("preprocessing");
+    this->preprocessing(image, buffers.plan, buffers.blob, inputTensorShape);
+    this->checkDeadline("preprocessing");
+
+    size_t inputTensorSize = utils::vectorProduct(inputTensorShape);
+
+    std::vector<Ort::Value> inputTensors;
+
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
+            OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+
+    inputTensors.push_back(Ort::Value::CreateTensor<float>(
+            memoryInfo, buffers.blob.data(), inputTensorSize,
+            inputTensorShape.data(), inputTensorShape.size()
+    )); // create input tensor object on the input buffer, without a copy
+
+    Ort::RunOptions runOptions;
+    if (this->memoryOptions.shrinkArenaAfterRun)
+        runOptions.AddConfigEntry("memory.enable_memory_arena_shrinkage", "cpu:0");
+
+    bool hasDeadline = this->deadline != std::chrono::steady_clock::time_point::max();
+    if (hasDeadline)
+        this->watchdog->arm(runOptions, this->deadline); // terminates the run at the deadline
+
+    std::vector<Ort::Value> outputTensors;
+    try
+    {
+        outputTensors = this->session.Run(runOptions,
+                                          inputNames.data(),
+                                          inputTensors.data(),
+                                          1,
+                                          outputNames.data(),
+                                          outputNames.size()); // run the model
+    }
+    catch (const Ort::Exception&)
+    {
+        if (hasDeadline && this->watchdog->disarm())
+            throw DeadlineExceeded("inference");
+        throw;
+    }
+    if (hasDeadline)
+        this->watchdog->disarm();
+
+    resizedImageShape = cv::Size((int)inputTensorShape[3], (int)inputTensorShape[2]); // get the resized image shape
+
+    return outputTensors;
+}
+
+/**
+ * @brief Detect objects in the image
+ * 
+ * detect(), detectTopK() and detectBatch() may run concurrently on one
+ * detector: each call takes its own letterbox plan and blob from a pool, and
+ * Session::Run is thread-safe. Detects with a deadline, adaptive resolution,
+ * detectAsync() and the setters change shared state, they must not overlap
+ * with other calls.
+ * 
+ * @param image Input image
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @return std::vector<Detection> 
+*/
+std::vector<Detection> YOLODetector::detect(cv::Mat &image, const float& confThreshold = 0.4,
+                                            const float& iouThreshold = 0.45)
+{
+    this->waitAsync(); // async frames share the session and the buffers of the detector
+    std::unique_ptr<InputBuffers> buffers = this->inputBufferPool->acquire();
+    cv::Size resizedShape;
+    std::vector<Ort::Value> outputTensors = this->inference(image, *buffers, resizedShape);
+
+    std::vector<Detection> result = this->postprocessing(buffers->plan,
+                                                         resizedShape,
+                                                         image.size(),
+                                                         outputTensors,
+                                                         confThreshold, iouThreshold,
+                                                         this->classSelection);
+
+    this->inputBufferPool->release(std::move(buffers), this->memoryOptions.releaseInputBufferAfterDetect);
+
+    if (this->adaptiveResolution)
+        this->updateAdaptiveResolution(result, image.size());
+
+    return result;
+}
+
+/**
+ * @brief Detect objects in the image, giving up at the deadline
+ * 
+ * A model run still going at the deadline is terminated through
+ * RunOptions::SetTerminate() by the watchdog thread, and the deadline is
+ * checked around preprocessing and after the decode.
+ * 
+ * @param image Input image
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @param deadline Time by which the result is needed
+ * @return std::vector<Detection> 
+ * @throws DeadlineExceeded if the deadline passed before the result was ready
+*/
+std::vector<Detection> YOLODetector::detect(cv::Mat &image, const float& confThreshold,
+                                            const float& iouThreshold,
+                                            const std::chrono::steady_clock::time_point& deadline)
+{
+    if (!this->watchdog)
+        this->watchdog = std::make_shared<RunWatchdog>();
+
+    this->waitAsync(); // the decode of async frames checks the deadline as well
+    this->deadline = deadline;
+    try
+    {
+        std::vector<Detection> result = this->detect(image, confThreshold, iouThreshold);
+        this->deadline = std::chrono::steady_clock::time_point::max();
+        return result;
+    }
+    catch (...)
+    {
+        this->deadline = std::chrono::steady_clock::time_point::max();
+        throw;
+    }
+}
+
+/**
+ * @brief Detect objects in several images with one model run
+ * 
+ * Every image is letterboxed to the full input size, so images of any
+ * resolution share the batch. Models with a fixed batch axis or a filtered
+ * output run the images one by one.
+ * 
+ * @param images Input images
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @return std::vector<std::vector<Detection>> Detections of each image
+*/
+std::vector<std::vector<Detection>> YOLODetector::detectBatch(std::vector<cv::Mat>& images,
+                                                              const float& confThreshold,
+                                                              const float& iouThreshold)
+{
+    this->waitAsync();
+    std::vector<std::vector<Detection>> results;
+    // the augmented post-processing graph handles one image per run
+    if (!this->isDynamicBatch || this->outputLayout == OutputLayout::Filtered || images.size() <= 1)
+    {
+        for (cv::Mat& image : images)
+            results.push_back(this->detect(image, confThreshold, iouThreshold));
+        return results;
+    }
+
+    cv::Size newShape = cv::Size(this->inputImageShape);
+    std::vector<int64_t> inputTensorShape {(int64_t)images.size(), 3, newShape.height, newShape.width};
+    size_t imageSize = 3 * (size_t)newShape.width * newShape.height;
+    std::unique_ptr<InputBuffers> buffers = this->inputBufferPool->acquire();
+    std::vector<utils::LetterboxPlan>& batchPlans = buffers->batchPlans;
+    buffers->blob.resize(images.size() * imageSize);
+
+    // too many resolutions, the tables are rebuilt as needed. Cleared up front,
+    // so the plan indices of this batch stay valid until its postprocessing
+    if (batchPlans.size() + images.size() > 16)
+        batchPlans.clear();
+    batchPlans.reserve(batchPlans.size() + images.size());
+
+    std::vector<size_t> planIndices;
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        auto plan = std::find_if(batchPlans.begin(), batchPlans.end(),
+                                 [&](const utils::LetterboxPlan& p) {
+                                     return p.matches(images[i].size(), newShape, false, true, 32);
+                                 });
+        if (plan == batchPlans.end())
+        {
+            batchPlans.emplace_back(images[i].size(), newShape, false, true, 32);
+            plan = batchPlans.end() - 1;
+        }
+        planIndices.push_back((size_t)(plan - batchPlans.begin()));
+
+        float* blob = buffers->blob.data() + i * imageSize;
+        if (this->preprocessPool)
+            plan->runParallel(images[i], blob, cv::Scalar(114, 114, 114), *this->preprocessPool);
+        else
+            plan->runParallel(images[i], blob, cv::Scalar(114, 114, 114), this->preprocessThreads);
+    }
+
+    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
+            OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+
+    std::vector<Ort::Value> inputTensors;
+    inputTensors.push_back(Ort::Value::CreateTensor<float>(
+            memoryInfo, buffers->blob.data(), buffers->blob.size(),
+            inputTensorShape.data(), inputTensorShape.size()
+    ));
+
+    Ort::RunOptions runOptions;
+    if (this->memoryOptions.shrinkArenaAfterRun)
+        runOptions.AddConfigEntry("memory.enable_memory_arena_shrinkage", "cpu:0");
+
+    std::vector<Ort::Value> outputTensors = this->session.Run(runOptions,
+                                                              inputNames.data(),
+                                                              inputTensors.data(),
+                                                              1,
+                                                              outputNames.data(),
+                                                              outputNames.size());
+
+    // decode each image through [1, ...] views on its slice of the outputs, without a copy
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        std::vector<Ort::Value> imageOutputs;
+        for (Ort::Value& outputTensor : outputTensors)
+        {
+            std::vector<int64_t> shape = outputTensor.GetTensorTypeAndShapeInfo().GetShape();
+            size_t count = utils::vectorProduct(shape) / images.size();
+            shape[0] = 1;
+
+            imageOutputs.push_back(Ort::Value::CreateTensor<float>(
+                    memoryInfo, outputTensor.GetTensorMutableData<float>() + i * count, count,
+                    shape.data(), shape.size()
+            ));
+        }
+
+        results.push_back(this->postprocessing(batchPlans[planIndices[i]], newShape, images[i].size(),
+                                               imageOutputs, confThreshold, iouThreshold,
+                                               this->classSelection));
+    }
+
+    this->inputBufferPool->release(std::move(buffers), this->memoryOptions.releaseInputBufferAfterDetect);
+
+    return results;
+}
+
+/**
+ * @brief Detect the k most confident objects in the image
+ * 
+ * Cheaper than detect() when only a few detections are needed, see
+ * postprocessingTopK().
+ * 
+ * @param image Input image
+ * @param k Maximum number of detections to return
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @return std::vector<Detection> Detections sorted by descending confidence
+*/
+std::vector<Detection> YOLODetector::detectTopK(cv::Mat &image, const int& k = 1,
+                                                const float& confThreshold = 0.4,
+                                                const float& iouThreshold = 0.45)
+{
+    this->waitAsync();
+    std::unique_ptr<InputBuffers> buffers = this->inputBufferPool->acquire();
+    cv::Size resizedShape;
+    std::vector<Ort::Value> outputTensors = this->inference(image, *buffers, resizedShape);
+
+    std::vector<Detection> result = this->postprocessingTopK(buffers->plan,
+                                                             resizedShape,
+                                                             image.size(),
+                                                             outputTensors,
+                                                             k, confThreshold, iouThreshold,
+                                                             this->classSelection);
+
+    this->inputBufferPool->release(std::move(buffers), this->memoryOptions.releaseInputBufferAfterDetect);
+
+    if (this->adaptiveResolution)
+        this->updateAdaptiveResolution(result, image.size());
+
+    return result;
+}
+
+/**
+ * @brief Queue the image for detection, overlapping its preprocessing with the
+ * model run of the previous frame
+ * 
+ * The image is letterboxed on the calling thread into one of two input slots,
+ * while the model runs and the detections are decoded on the inference thread
+ * of the detector. The call blocks only while both slots are in use, so the
+ * image can be reused as soon as it returns. Frames finish in order.
+ * Adaptive resolution is not updated by async frames, and like detect() the
+ * method must not be called from several threads at once.
+ * 
+ * The class filter and the memory options are copied when the frame is queued.
+ * The other sync methods and the setters wait for the frames in flight first.
+ * Queued frames refer to the detector itself, so it must not be moved, or
+ * assigned to, before waitAsync() returned.
+ * 
+ * @param image Input image
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @return std::future<std::vector<Detection>> Detections, or the error of the frame
+*/
+std::future<std::vector<Detection>> YOLODetector::detectAsync(const cv::Mat& image,
+                                                              const float& confThreshold = 0.4,
+                                                              const float& iouThreshold = 0.45)
+{
+    auto promise = std::make_shared<std::promise<std::vector<Detection>>>();
+    std::future<std::vector<Detection>> future = promise->get_future();
+    this->detectAsync(image, confThreshold, iouThreshold,
+                      [promise](std::vector<Detection> detections, std::exception_ptr error) {
+                          if (error)
+                              promise->set_exception(error);
+                          else
+                              promise->set_value(std::move(detections));
+                      });
+
+    return future;
+}
+
+/**
+ * @brief Queue the image for detection, see detectAsync() above
+ * 
+ * The callback runs on the inference thread and delays the next frame, so it
+ * should only hand the detections over. It runs on the calling thread when
+ * the preprocessing fails. It must not call waitAsync(), a detect or a setter
+ * of the same detector: they wait for the frame the callback belongs to, and
+ * the inference thread deadlocks.
+ * 
+ * @param image Input image
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @param callback Receives the detections, or the error of the frame
+*/
+void YOLODetector::detectAsync(const cv::Mat& image, const float& confThreshold, const float& iouThreshold,
+                               const DetectCallback& callback)
+{
+    if (!this->asyncPipeline)
+        this->asyncPipeline.reset(new AsyncPipeline());
+    AsyncPipeline* pipeline = this->asyncPipeline.get();
+
+    size_t slotIndex = pipeline->acquireSlot();
+    AsyncSlot& slot = pipeline->slots[slotIndex];
+    try
+    {
+        this->preprocessing(image, slot.plan, slot.blob, slot.inputTensorShape);
+    }
+    catch (...)
+    {
+        pipeline->releaseSlot(slotIndex);
+        callback(std::vector<Detection>(), std::current_exception());
+        return;
+    }
+
+    // copied now, the filter and the options may change before the frame runs
+    cv::Size originalShape = image.size();
+    ClassSelection classes = this->classSelection;
+    MemoryOptions memoryOptions = this->memoryOptions;
+    pipeline->inferenceStage.enqueue([this, pipeline, slotIndex, originalShape, classes, memoryOptions,
+                                      confThreshold, iouThreshold, callback]() {
+        AsyncSlot& slot = pipeline->slots[slotIndex];
+        std::vector<Detection> detections;
+        std::exception_ptr error;
+        try
+        {
+            Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(
+                    OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+            Ort::Value inputTensor = Ort::Value::CreateTensor<float>(
+                    memoryInfo, slot.blob.data(), slot.blob.size(),
+                    slot.inputTensorShape.data(), slot.inputTensorShape.size());
+
+            Ort::RunOptions runOptions;
+            if (memoryOptions.shrinkArenaAfterRun)
+                runOptions.AddConfigEntry("memory.enable_memory_arena_shrinkage", "cpu:0");
+
+            std::vector<Ort::Value> outputTensors = this->session.Run(runOptions,
+                                                                      inputNames.data(),
+                                                                      &inputTensor,
+                                                                      1,
+                                                                      outputNames.data(),
+                                                                      outputNames.size());
+
+            cv::Size resizedShape((int)slot.inputTensorShape[3], (int)slot.inputTensorShape[2]);
+            detections = this->postprocessing(slot.plan, resizedShape, originalShape, outputTensors,
+                                              confThreshold, iouThreshold, classes);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        if (memoryOptions.releaseInputBufferAfterDetect)
+            std::vector<float>().swap(slot.blob);
+
+        try
+        {
+            callback(std::move(detections), error);
+        }
+        catch (...)
+        {
+            // nobody to report to on the inference thread, the slot must be released anyway
+        }
+        pipeline->releaseSlot(slotIndex);
+    });
+}
+
+/**
+ * @brief Take the buffers of the last finished detect, or new ones when all are in use
+ * 
+ * @return std::unique_ptr<InputBuffers>
+*/
+std::unique_ptr<YOLODetector::InputBuffers> YOLODetector::InputBufferPool::acquire()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->buffers.empty())
+        return std::unique_ptr<InputBuffers>(new InputBuffers());
+
+    std::unique_ptr<InputBuffers> inputBuffers = std::move(this->buffers.back());
+    this->buffers.pop_back();
+    return inputBuffers;
+}
+
+/**
+ * @brief Give the buffers of a finished detect back to the pool
+ * 
+ * @param inputBuffers Buffers taken with acquire()
+ * @param freeBlob Free the blob, the letterbox plans are kept
+*/
+void YOLODetector::InputBufferPool::release(std::unique_ptr<InputBuffers> inputBuffers, const bool& freeBlob)
+{
+    if (freeBlob)
+        std::vector<float>().swap(inputBuffers->blob);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->buffers.push_back(std::move(inputBuffers));
+}
+
+/**
+ * @brief Wait until every frame queued with detectAsync() has been delivered
+*/
+void YOLODetector::waitAsync()
+{
+    if (this->asyncPipeline)
+        this->asyncPipeline->wait();
+}
+
+/**
+ * @brief Take a free input slot, waiting while both are in use
+ * 
+ * @return size_t Index of the slot
+*/
+size_t YOLODetector::AsyncPipeline::acquireSlot()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->condition.wait(lock, [this]() { return !this->freeSlots.empty(); });
+
+    size_t index = this->freeSlots.back();
+    this->freeSlots.pop_back();
+    this->inFlight++;
+
+    return index;
+}
+
+/**
+ * @brief Return a slot once its frame was delivered
+ * 
+ * @param index Index of the slot
+*/
+void YOLODetector::AsyncPipeline::releaseSlot(const size_t& index)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->freeSlots.push_back(index);
+        this->inFlight--;
+    }
+    this->condition.notify_all();
+}
+
+/**
+ * @brief Wait until no frame is in flight
+*/
+void YOLODetector::AsyncPipeline::wait()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->condition.wait(lock, [this]() { return this->inFlight == 0; });
+}
+
+/**
+ * @brief Restrict the decode to a subset of classes
+ * 
+ * Disallowed classes never enter the argmax or NMS.
+ * 
+ * @param classIds Allowed class ids, empty to allow all classes
+*/
+void YOLODetector::setAllowedClasses(const std::vector<int>& classIds)
+{
+    this->waitAsync();
+    this->classSelection.allowedClassIds = classIds;
+}
+
+/**
+ * @brief Override the confidence threshold of one class
+ * 
+ * @param classId Class id
+ * @param threshold Confidence threshold used instead of confThreshold
+*/
+void YOLODetector::setClassConfThreshold(const int& classId, const float& threshold)
+{
+    this->waitAsync();
+    this->classSelection.classConfThresholds[classId] = threshold;
+}
+
+/**
+ * @brief Allow all classes again and drop the per-class thresholds
+*/
+void YOLODetector::clearClassFilter()
+{
+    this->waitAsync();
+    this->classSelection.allowedClassIds.clear();
+    this->classSelection.classConfThresholds.clear();
+}
+
+/**
+ * @brief Set the anchors used to decode raw detection heads
+ * 
+ * @param anchors (w, h) pairs of each head, from the finest to the coarsest stride
+*/
+void YOLODetector::setAnchors(const std::vector<std::vector<float>>& anchors)
+{
+    this->waitAsync();
+    this->anchors = anchors;
+}
+
+/**
+ * @brief Split the preprocessing into row bands across OpenCV's worker pool
+ * 
+ * The pool size itself follows cv::setNumThreads().
+ * 
+ * @param numThreads Number of row bands, 1 runs on the calling thread, 0 uses cv::getNumThreads()
+*/
+void YOLODetector::setPreprocessThreads(const int& numThreads)
+{
+    this->waitAsync();
+    this->preprocessThreads = numThreads > 0 ? numThreads : cv::getNumThreads();
+}
+
+/**
+ * @brief Split the decode of large outputs into chunks across worker threads
+ * 
+ * Runs on the pinned preprocessing workers when there are some, otherwise on
+ * OpenCV's pool. The detections do not depend on the number of threads.
+ * 
+ * @param numThreads Number of workers, 1 runs on the calling thread, 0 uses cv::getNumThreads()
+*/
+void YOLODetector::setDecodeThreads(const int& numThreads)
+{
+    this->waitAsync();
+    this->decodeThreads = numThreads > 0 ? numThreads : cv::getNumThreads();
+}
+
+/**
+ * @brief Abandon the frame if the deadline of the current detect passed
+ * 
+ * @param stage Stage reported in the exception
+ * @throws DeadlineExceeded
+*/
+void YOLODetector::checkDeadline(const char* stage) const
+{
+    if (this->deadline != std::chrono::steady_clock::time_point::max() &&
+        std::chrono::steady_clock::now() >= this->deadline)
+        throw DeadlineExceeded(stage);
+}
+
+/**
+ * @brief Pick the input resolution from the statistics of recent frames
+ * 
+ * Only for models with a dynamic input shape. The resolution steps down one size
+ * after downscaleFrames consecutive frames whose detections are all large and
+ * few, and goes back to the largest size after upscaleFrames consecutive frames
+ * with a small box or a low mean confidence. The first emptyDetailFrames empty
+ * frames after a frame with detections count as detail frames, the objects may
+ * have been lost to a lower size; later empty frames count as large and sparse,
+ * so an empty scene steps down as well. Every size is run once here, so
+ * switching never pays a first-run cost.
+ * 
+ * @param options Sizes and switching thresholds
+*/
+void YOLODetector::enableAdaptiveResolution(const AdaptiveResolutionOptions& options)
+{
+    this->waitAsync();
+    if (!this->isDynamicInputShape)
+    {
+        std::cout << "Adaptive resolution needs a dynamic input shape, keeping "
+                  << this->getInputSize() << std::endl;
+        return;
+    }
+
+    this->adaptiveOptions = options;
+    std::vector<int>& sizes = this->adaptiveOptions.sizes;
+    if (sizes.empty())
+        sizes.push_back((int)this->inputImageShape.width);
+    for (int& size : sizes)
+        size = std::max(32, (size + 16) / 32 * 32); // the letterbox pads to a stride of 32
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+
+    // prewarm from the smallest to the largest size, which is kept
+    cv::Size frameSize = options.frameSize.area() > 0 ? options.frameSize : cv::Size(sizes.back(), sizes.back());
+    cv::Mat frame = cv::Mat::zeros(frameSize, CV_8UC3);
+    std::unique_ptr<InputBuffers> buffers = this->inputBufferPool->acquire();
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        this->setInputSizeIndex(i);
+        cv::Size resizedShape;
+        this->inference(frame, *buffers, resizedShape);
+        std::cout << "Prewarmed input size: " << resizedShape << std::endl;
+    }
+    this->inputBufferPool->release(std::move(buffers), false);
+
+    this->adaptiveResolution = true;
+}
+
+/**
+ * @brief Stop adapting, the current input size is kept
+*/
+void YOLODetector::disableAdaptiveResolution()
+{
+    this->waitAsync();
+    this->adaptiveResolution = false;
+}
+
+/**
+ * @brief Letterbox the next frames to another input size, on the same session
+ * 
+ * The first run at a new size plans its memory, so sizes used under a latency
+ * budget should be prewarmed. Adaptive resolution, when enabled, changes the
+ * size again after the next frame.
+ * 
+ * @param inputSize New input size
+ * @throws std::invalid_argument if the model has a fixed input shape of another size
+*/
+void YOLODetector::setInputSize(const cv::Size& inputSize)
+{
+    this->waitAsync();
+    if (!this->isDynamicInputShape && inputSize != this->getInputSize())
+        throw std::invalid_argument("The input size of a model with a fixed input shape cannot change");
+
+    this->inputImageShape = cv::Size2f(inputSize);
+}
+
+/**
+ * @brief Get the input size the next frame is letterboxed to
+ * 
+ * @return cv::Size 
+*/
+cv::Size YOLODetector::getInputSize() const
+{
+    return cv::Size(this->inputImageShape);
+}
+
+/**
+ * @brief Switch to one of the adaptive sizes and restart the hysteresis
+ * 
+ * @param index Index into adaptiveOptions.sizes
+*/
+void YOLODetector::setInputSizeIndex(const size_t& index)
+{
+    int size = this->adaptiveOptions.sizes[index];
+    this->adaptiveSizeIndex = index;
+    this->inputImageShape = cv::Size2f((float)size, (float)size);
+    this->downscaleStreak = 0;
+    this->upscaleStreak = 0;
+}
+
+/**
+ * @brief Update the hysteresis with the detections of one frame
+ * 
+ * An empty frame shortly after detections counts as one needing detail, so
+ * the size goes back up when objects vanish after a step down. Once the
+ * budget of such frames is spent, empty frames count as large and sparse.
+ * 
+ * @param detections Detections in the original image
+ * @param imageShape Original image shape
+*/
+void YOLODetector::updateAdaptiveResolution(const std::vector<Detection>& detections, const cv::Size& imageShape)
+{
+    if (imageShape.area() <= 0)
+        return;
+
+    const AdaptiveResolutionOptions& options = this->adaptiveOptions;
+
+    float minArea = 1.0f;
+    float confSum = 0.0f;
+    for (const Detection& detection : detections)
+    {
+        minArea = std::min(minArea, (float)detection.box.area() / (float)imageShape.area());
+        confSum += detection.conf;
+    }
+    bool needsDetail, largeAndSparse;
+    if (detections.empty())
+    {
+        // vanished objects may be lost to a lower resolution, a scene empty for longer is just empty
+        needsDetail = this->emptyDetailBudget > 0;
+        largeAndSparse = !needsDetail;
+        if (needsDetail)
+            this->emptyDetailBudget--;
+    }
+    else
+    {
+        float meanConf = confSum / (float)detections.size();
+        needsDetail = minArea < options.smallObjectArea || meanConf < options.lowConfidence;
+        largeAndSparse = !needsDetail && minArea >= options.largeObjectArea &&
+                         (int)detections.size() <= options.maxSparseDetections;
+        this->emptyDetailBudget = options.emptyDetailFrames;
+    }
+
+    this->upscaleStreak = needsDetail ? this->upscaleStreak + 1 : 0;
+    this->downscaleStreak = largeAndSparse ? this->downscaleStreak + 1 : 0;
+
+    size_t largest = options.sizes.size() - 1;
+    if (this->adaptiveSizeIndex < largest && this->upscaleStreak >= options.upscaleFrames)
+    {
+        this->setInputSizeIndex(largest);
+        std::cout << "Input size raised to " << this->getInputSize() << std::endl;
+    }
+    else if (this->adaptiveSizeIndex > 0 && this->downscaleStreak >= options.downscaleFrames)
+    {
+        this->setInputSizeIndex(this->adaptiveSizeIndex - 1);
+        std::cout << "Input size lowered to " << this->getInputSize() << std::endl;
+    }
+}
+
+/**
+ * @brief Free the input buffers kept between frames
+ * 
+ * The next detect reallocates them. The output tensors are owned by ORT and
+ * freed once a detect returned, their memory goes back to the arena.
+*/
+void YOLODetector::releaseInputBuffers()
+{
+    this->waitAsync();
+    std::lock_guard<std::mutex> lock(this->inputBufferPool->mutex);
+    for (std::unique_ptr<InputBuffers>& buffers : this->inputBufferPool->buffers)
+        std::vector<float>().swap(buffers->blob);
+}
+
+/**
+ * @brief Report the memory usage of the process and the detector
+ * 
+ * ORT does not expose the usage of its arena, only its configured limit is
+ * reported, the arena itself is part of the resident set size.
+ * 
+ * @return MemoryStats 
+*/
+MemoryStats YOLODetector::memoryStats() const
+{
+    MemoryStats stats;
+    utils::getMemoryUsage(stats.rssBytes, stats.peakRssBytes);
+    {
+        std::lock_guard<std::mutex> lock(this->inputBufferPool->mutex);
+        for (const std::unique_ptr<InputBuffers>& buffers : this->inputBufferPool->buffers)
+            stats.inputBufferBytes += buffers->blob.capacity() * sizeof(float);
+    }
+    stats.arenaLimitBytes = this->memoryOptions.arenaMaxMemory;
+
+    return stats;
 }
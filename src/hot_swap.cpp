@@ -0,0 +1,229 @@
+#include "hot_swap.h"
+
+/**
+ * @brief Load and warm up the first model, and start watching its file if enabled
+ * 
+ * @param modelPath Path to the onnx model
+ * @param isGPU Run on CUDA
+ * @param inputSize Input size of the model
+ * @param detectorOptions Options of every model loaded by the handle
+ * @param options Warm-up and file watching
+ * @throws std::exception if the first model cannot be loaded
+*/
+HotSwapDetector::HotSwapDetector(const std::string& modelPath, const bool& isGPU, const cv::Size& inputSize,
+                                 const DetectorOptions& detectorOptions, const HotSwapOptions& options)
+    : isGPU(isGPU), inputSize(inputSize), detectorOptions(detectorOptions), options(options)
+{
+    auto start = std::chrono::steady_clock::now();
+    this->current = this->createInstance(modelPath);
+    auto end = std::chrono::steady_clock::now();
+
+    this->stats.modelPath = modelPath;
+    this->stats.lastLoadMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+    if (this->options.watchFile)
+        this->watcher = std::thread(&HotSwapDetector::watch, this);
+}
+
+/**
+ * @brief Stop watching the model file, a reload already queued still completes
+*/
+HotSwapDetector::~HotSwapDetector()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->watcherCondition.notify_all();
+
+    if (this->watcher.joinable())
+        this->watcher.join();
+}
+
+/**
+ * @brief Detect objects in the image with the current model
+ * 
+ * @param image Input image
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @return std::vector<Detection>
+*/
+std::vector<Detection> HotSwapDetector::detect(cv::Mat &image, const float& confThreshold = 0.4,
+                                               const float& iouThreshold = 0.45)
+{
+    std::shared_ptr<Instance> instance = this->acquire();
+    std::lock_guard<std::mutex> lock(instance->mutex);
+    return instance->detector.detect(image, confThreshold, iouThreshold);
+}
+
+/**
+ * @brief Detect the k most confident objects in the image with the current model
+ * 
+ * @param image Input image
+ * @param k Maximum number of detections to return
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @return std::vector<Detection> Detections sorted by descending confidence
+*/
+std::vector<Detection> HotSwapDetector::detectTopK(cv::Mat &image, const int& k = 1,
+                                                   const float& confThreshold = 0.4,
+                                                   const float& iouThreshold = 0.45)
+{
+    std::shared_ptr<Instance> instance = this->acquire();
+    std::lock_guard<std::mutex> lock(instance->mutex);
+    return instance->detector.detectTopK(image, k, confThreshold, iouThreshold);
+}
+
+/**
+ * @brief Reload the current model file in the background
+ * 
+ * @return std::future<bool> true once the reloaded model serves, false if the load failed
+*/
+std::future<bool> HotSwapDetector::reload()
+{
+    return this->reload(this->getStats().modelPath);
+}
+
+/**
+ * @brief Load another model in the background and switch to it once it is warm
+ * 
+ * Reloads run one after the other on the loader thread, the last one wins.
+ * 
+ * @param modelPath Path to the onnx model
+ * @return std::future<bool> true once the new model serves, false if the load failed
+*/
+std::future<bool> HotSwapDetector::reload(const std::string& modelPath)
+{
+    return this->loader.enqueue([this, modelPath]() { return this->load(modelPath); });
+}
+
+/**
+ * @brief Get the generation and load statistics of the handle
+ * 
+ * @return HotSwapStats
+*/
+HotSwapStats HotSwapDetector::getStats() const
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->stats;
+}
+
+/**
+ * @brief Take a reference on the current model, which keeps it alive until the request is done
+ * 
+ * @return std::shared_ptr<Instance>
+*/
+std::shared_ptr<HotSwapDetector::Instance> HotSwapDetector::acquire() const
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->current;
+}
+
+/**
+ * @brief Load a model and run the warm-up detects on it
+ * 
+ * The first runs allocate the arena and the memory pattern of the session, so
+ * they are paid here instead of by the first requests after the switch.
+ * 
+ * @param modelPath Path to the onnx model
+ * @return std::shared_ptr<Instance>
+ * @throws std::exception if the model cannot be loaded or run
+*/
+std::shared_ptr<HotSwapDetector::Instance> HotSwapDetector::createInstance(const std::string& modelPath) const
+{
+    auto instance = std::make_shared<Instance>(modelPath, this->isGPU, this->inputSize, this->detectorOptions);
+
+    cv::Size frameSize = this->options.warmupFrameSize.empty() ? this->inputSize : this->options.warmupFrameSize;
+    cv::Mat frame(frameSize, CV_8UC3, cv::Scalar(114, 114, 114));
+    for (int i = 0; i < this->options.warmupRuns; i++)
+        instance->detector.detect(frame, 0.4f, 0.45f);
+
+    return instance;
+}
+
+/**
+ * @brief Load a model on the loader thread and switch to it
+ * 
+ * @param modelPath Path to the onnx model
+ * @return true if the new model serves
+*/
+bool HotSwapDetector::load(const std::string& modelPath)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<Instance> instance;
+    try
+    {
+        instance = this->createInstance(modelPath);
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Failed to load " << modelPath << ", keeping the current model: " << e.what() << std::endl;
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stats.failedLoads++;
+        return false;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->current.swap(instance);
+        this->stats.generation++;
+        this->stats.lastLoadMs = std::chrono::duration<double, std::milli>(end - start).count();
+        this->stats.modelPath = modelPath;
+    }
+    std::cout << "Switched to " << modelPath << " after "
+              << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+
+    // instance now holds the previous model, released here or by its last running request
+    return true;
+}
+
+/**
+ * @brief Poll the size and mtime of the current model file and reload it when they change
+ * 
+ * A change is only acted on once the file is the same in two polls in a row,
+ * so a model still being copied is not loaded half-written.
+*/
+void HotSwapDetector::watch()
+{
+    std::string watchedPath;
+    uint64_t size = 0, pendingSize = 0;
+    int64_t mtime = 0, pendingMtime = 0;
+    bool pending = false;
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (!this->stopping)
+    {
+        if (watchedPath != this->stats.modelPath)
+        {
+            // a reload switched files, watch the new one from its current state
+            watchedPath = this->stats.modelPath;
+            utils::statFile(watchedPath, size, mtime);
+            pending = false;
+        }
+
+        lock.unlock();
+        uint64_t currentSize = 0;
+        int64_t currentMtime = 0;
+        bool exists = utils::statFile(watchedPath, currentSize, currentMtime);
+        if (exists && (currentSize != size || currentMtime != mtime))
+        {
+            if (pending && currentSize == pendingSize && currentMtime == pendingMtime)
+            {
+                size = currentSize;
+                mtime = currentMtime;
+                pending = false;
+                this->reload(watchedPath);
+            }
+            else
+            {
+                pending = true;
+                pendingSize = currentSize;
+                pendingMtime = currentMtime;
+            }
+        }
+        lock.lock();
+
+        this->watcherCondition.wait_for(lock, this->options.pollInterval, [this]() { return this->stopping; });
+    }
+}
@@ -0,0 +1,294 @@
+#include "letterbox.h"
+
+/**
+ * @brief Compute the letterbox geometry and the bilinear tables
+ * 
+ * Matches utils::letterbox without scaleFill.
+ * 
+ * @param sourceShape Shape of the source image
+ * @param newShape New shape of output image
+ * @param auto_ Whether to only pad to a stride multiple
+ * @param scaleUp Whether to scale up image
+ * @param stride Stride
+*/
+utils::LetterboxPlan::LetterboxPlan(const cv::Size& sourceShape,
+                                    const cv::Size& newShape,
+                                    bool auto_,
+                                    bool scaleUp,
+                                    int stride)
+    : sourceShape(sourceShape), newShape(newShape), auto_(auto_), scaleUp(scaleUp), stride(stride)
+{
+    ratio = std::min((float)newShape.height / (float)sourceShape.height,
+                     (float)newShape.width / (float)sourceShape.width);
+    if (!scaleUp)
+        ratio = std::min(ratio, 1.0f);
+
+    unpadShape = cv::Size((int)std::round((float)sourceShape.width * ratio),
+                          (int)std::round((float)sourceShape.height * ratio));
+
+    // Compute padding
+    auto dw = (float)(newShape.width - unpadShape.width);
+    auto dh = (float)(newShape.height - unpadShape.height);
+
+    if (auto_)
+    {
+        // only pad to a stride multiple
+        dw = (float)((int)dw % stride);
+        dh = (float)((int)dh % stride);
+    }
+
+    dw /= 2.0f;
+    dh /= 2.0f;
+
+    padTop = int(std::round(dh - 0.1f));
+    padLeft = int(std::round(dw - 0.1f));
+    int padBottom = int(std::round(dh + 0.1f));
+    int padRight = int(std::round(dw + 0.1f));
+    outShape = cv::Size(unpadShape.width + padLeft + padRight,
+                        unpadShape.height + padTop + padBottom);
+
+    buildTable(sourceShape.width, unpadShape.width, xOffsets0, xOffsets1, xWeights);
+    buildTable(sourceShape.height, unpadShape.height, yIndices0, yIndices1, yWeights);
+
+    // x indices are used as byte offsets into BGR rows
+    for (size_t i = 0; i < xOffsets0.size(); i++)
+    {
+        xOffsets0[i] *= 3;
+        xOffsets1[i] *= 3;
+    }
+}
+
+/**
+ * @brief Build the source indices and weights of a bilinear resize along one axis
+ * 
+ * Uses the same half-pixel mapping as cv::resize with INTER_LINEAR.
+ * 
+ * @param sourceLength Source length
+ * @param resizedLength Resized length
+ * @param indices0 Left/top source index of each resized pixel
+ * @param indices1 Right/bottom source index of each resized pixel
+ * @param weights Weight of indices1
+ */
+void utils::LetterboxPlan::buildTable(int sourceLength, int resizedLength,
+                                      std::vector<int>& indices0, std::vector<int>& indices1,
+                                      std::vector<float>& weights)
+{
+    indices0.resize(resizedLength);
+    indices1.resize(resizedLength);
+    weights.resize(resizedLength);
+
+    double scale = (double)sourceLength / (double)resizedLength;
+    for (int i = 0; i < resizedLength; i++)
+    {
+        double position = ((double)i + 0.5) * scale - 0.5;
+        int index = (int)std::floor(position);
+        float weight = (float)(position - index);
+
+        if (index < 0)
+        {
+            index = 0;
+            weight = 0.0f;
+        }
+        if (index >= sourceLength - 1)
+        {
+            index = sourceLength - 1;
+            weight = 0.0f;
+        }
+
+        indices0[i] = index;
+        indices1[i] = std::min(index + 1, sourceLength - 1);
+        weights[i] = weight;
+    }
+}
+
+/**
+ * @brief Check if the plan was built for these parameters
+ * 
+ * @return true if the plan can be reused
+ */
+bool utils::LetterboxPlan::matches(const cv::Size& sourceShape,
+                                   const cv::Size& newShape,
+                                   bool auto_,
+                                   bool scaleUp,
+                                   int stride) const
+{
+    return this->sourceShape == sourceShape && this->newShape == newShape &&
+           this->auto_ == auto_ && this->scaleUp == scaleUp && this->stride == stride;
+}
+
+/**
+ * @brief Letterbox a BGR image straight into a normalized RGB CHW blob
+ * 
+ * Resize, padding, BGR to RGB, 1 / 255 scaling and HWC to CHW are done in one
+ * pass over the output, without intermediate images.
+ * 
+ * @param image 8-bit source image of the planned shape, grayscale and BGRA are converted first
+ * @param blob Output blob of 3 * outputShape().area() floats
+ * @param color Color of padding (RGB)
+ */
+void utils::LetterboxPlan::run(const cv::Mat& image, float* blob, const cv::Scalar& color) const
+{
+    this->run(LetterboxPlan::toBgr(image), blob, color, 0, outShape.height);
+}
+
+/**
+ * @brief Convert a grayscale or BGRA image to the BGR the bands read
+ * 
+ * @param image Source image
+ * @return cv::Mat The image itself when it already is BGR
+ */
+cv::Mat utils::LetterboxPlan::toBgr(const cv::Mat& image)
+{
+    cv::Mat bgr;
+    if (image.channels() == 1)
+        cv::cvtColor(image, bgr, cv::COLOR_GRAY2BGR);
+    else if (image.channels() == 4)
+        cv::cvtColor(image, bgr, cv::COLOR_BGRA2BGR);
+    else
+        bgr = image;
+
+    return bgr;
+}
+
+/**
+ * @brief Letterbox a band of output rows, see run()
+ * 
+ * Bands write disjoint rows of the blob, so they can run concurrently.
+ * 
+ * @param image 8-bit BGR source image of the planned shape
+ * @param blob Output blob of 3 * outputShape().area() floats
+ * @param color Color of padding (RGB)
+ * @param rowBegin First output row
+ * @param rowEnd Output row after the last one
+ */
+void utils::LetterboxPlan::run(const cv::Mat& image, float* blob, const cv::Scalar& color,
+                               int rowBegin, int rowEnd) const
+{
+    CV_Assert(image.type() == CV_8UC3 && image.size() == sourceShape);
+
+    const float scale = 1.0f / 255.0f;
+    const size_t planeSize = (size_t)outShape.area();
+    float* planes[3] = {blob, blob + planeSize, blob + 2 * planeSize}; // R, G, B
+    const float padValues[3] = {(float)color[0] * scale, (float)color[1] * scale, (float)color[2] * scale};
+
+    for (int y = rowBegin; y < rowEnd; y++)
+    {
+        size_t rowOffset = (size_t)y * outShape.width;
+        int sy = y - padTop;
+
+        if (sy < 0 || sy >= unpadShape.height)
+        {
+            for (int c = 0; c < 3; c++)
+                std::fill(planes[c] + rowOffset, planes[c] + rowOffset + outShape.width, padValues[c]);
+            continue;
+        }
+
+        int right = padLeft + unpadShape.width;
+        for (int c = 0; c < 3; c++)
+        {
+            std::fill(planes[c] + rowOffset, planes[c] + rowOffset + padLeft, padValues[c]);
+            std::fill(planes[c] + rowOffset + right, planes[c] + rowOffset + outShape.width, padValues[c]);
+        }
+
+        const uchar* row0 = image.ptr<uchar>(yIndices0[sy]);
+        const uchar* row1 = image.ptr<uchar>(yIndices1[sy]);
+        float wy = yWeights[sy];
+
+        float* r = planes[0] + rowOffset + padLeft;
+        float* g = planes[1] + rowOffset + padLeft;
+        float* b = planes[2] + rowOffset + padLeft;
+
+        for (int x = 0; x < unpadShape.width; x++)
+        {
+            int x0 = xOffsets0[x];
+            int x1 = xOffsets1[x];
+            float wx = xWeights[x];
+
+            float top[3], bottom[3];
+            for (int c = 0; c < 3; c++)
+            {
+                top[c] = (float)row0[x0 + c] + ((float)row0[x1 + c] - (float)row0[x0 + c]) * wx;
+                bottom[c] = (float)row1[x0 + c] + ((float)row1[x1 + c] - (float)row1[x0 + c]) * wx;
+            }
+
+            // source is BGR
+            b[x] = (top[0] + (bottom[0] - top[0]) * wy) * scale;
+            g[x] = (top[1] + (bottom[1] - top[1]) * wy) * scale;
+            r[x] = (top[2] + (bottom[2] - top[2]) * wy) * scale;
+        }
+    }
+}
+
+/**
+ * @brief Letterbox the image with the output rows split into bands across OpenCV's worker pool
+ * 
+ * @param image 8-bit source image of the planned shape, grayscale and BGRA are converted first
+ * @param blob Output blob of 3 * outputShape().area() floats
+ * @param color Color of padding (RGB)
+ * @param numBands Number of row bands, 1 runs on the calling thread
+ */
+void utils::LetterboxPlan::runParallel(const cv::Mat& image, float* blob, const cv::Scalar& color,
+                                       int numBands) const
+{
+    cv::Mat bgr = LetterboxPlan::toBgr(image); // once, not per band
+    if (numBands <= 1 || outShape.height < 2 * numBands)
+    {
+        this->run(bgr, blob, color, 0, outShape.height);
+        return;
+    }
+
+    cv::parallel_for_(cv::Range(0, outShape.height), [&](const cv::Range& range) {
+        this->run(bgr, blob, color, range.start, range.end);
+    }, (double)numBands);
+}
+
+/**
+ * @brief Letterbox the image with one band of output rows per worker of the pool
+ * 
+ * @param image 8-bit source image of the planned shape, grayscale and BGRA are converted first
+ * @param blob Output blob of 3 * outputShape().area() floats
+ * @param color Color of padding (RGB)
+ * @param pool Worker pool
+ */
+void utils::LetterboxPlan::runParallel(const cv::Mat& image, float* blob, const cv::Scalar& color,
+                                       ThreadPool& pool) const
+{
+    cv::Mat bgr = LetterboxPlan::toBgr(image); // once, not per band
+    int numBands = std::min(pool.size(), outShape.height);
+    int bandHeight = (outShape.height + numBands - 1) / numBands;
+
+    pool.parallelFor(numBands, [&](int band) {
+        int rowBegin = band * bandHeight;
+        int rowEnd = std::min(rowBegin + bandHeight, outShape.height);
+        if (rowBegin < rowEnd)
+            this->run(bgr, blob, color, rowBegin, rowEnd);
+    });
+}
+
+/**
+ * @brief Transform a box from the source image to the letterboxed image
+ * 
+ * @param box Box in the source image
+ * @return cv::Rect Box in the letterboxed image
+ */
+cv::Rect utils::LetterboxPlan::forward(const cv::Rect& box) const
+{
+    return cv::Rect((int)std::round((float)box.x * ratio) + padLeft,
+                    (int)std::round((float)box.y * ratio) + padTop,
+                    (int)std::round((float)box.width * ratio),
+                    (int)std::round((float)box.height * ratio));
+}
+
+/**
+ * @brief Transform a box from the letterboxed image to the source image
+ * 
+ * @param box Box in the letterboxed image
+ * @return cv::Rect Box in the source image
+ */
+cv::Rect utils::LetterboxPlan::inverse(const cv::Rect& box) const
+{
+    return cv::Rect((int)std::round((float)(box.x - padLeft) / ratio),
+                    (int)std::round((float)(box.y - padTop) / ratio),
+                    (int)std::round((float)box.width / ratio),
+                    (int)std::round((float)box.height / ratio));
+}
@@ -3,6 +3,8 @@
 #include "cmdline.h"
 #include "utils.h"
 #include "detector.h"
+#include "manifest.h"
+#include "renderer.h"
 
 #define MUTIPLE 0 // 0: single image, 1: multiple images
 
@@ -42,53 +44,84 @@ int main(int argc, char* argv[])
     std::string imagePath;
 
     #if MUTIPLE == 1
+        // annotate and encode on worker threads, so detection never waits for the PNG encoder
+        AsyncRenderer renderer(classNames, 2, 8, EncoderOptions());
+
+        // files unchanged since the last run with the same model and thresholds are skipped
+        ResultsManifest manifest("../CL01_WVC/manifest.bin",
+                                 ResultsManifest::hashConfig(modelPath, cv::Size(640, 640),
+                                                             confThreshold, iouThreshold));
+
+        bool isInitialized = false;
         for(int i = 421; i <= 455; i++)
         {
             imagePath = "../CL01_WVC/" + std::to_string(i) + ".png";
             std::cout << imagePath << std::endl;
-            try
-            {
-                detector = YOLODetector(modelPath, isGPU, cv::Size(640, 640));
-                std::cout << "Model was initialized." << std::endl;
 
-                image = cv::imread(imagePath);
-                result = detector.detect(image, confThreshold, iouThreshold);
-                if(result.empty())
+            // reused files are reported like detected ones, only their rendering is skipped
+            bool isReused = manifest.lookup(imagePath, result);
+            if (isReused)
+            {
+                std::cout << "Unchanged, " << result.size() << " detections from the manifest" << std::endl;
+            }
+            else
+            {
+                try
                 {
-                    std::cerr << "No car exists!" << std::endl;
-                    return 0;
+                    // created once, by the first file that is not in the manifest
+                    if (!isInitialized)
+                    {
+                        detector = YOLODetector(modelPath, isGPU, cv::Size(640, 640));
+                        isInitialized = true;
+                        std::cout << "Model was initialized." << std::endl;
+                    }
+
+                    image = cv::imread(imagePath);
+                    result = detector.detectTopK(image, 1, confThreshold, iouThreshold); // only the most confident car is used
+                    manifest.record(imagePath, result); // an empty result is kept as well, the rerun stops here too
+                }
+                // catch the exception thrown by the constructor
+                catch(const std::exception& e)
+                {
+                    std::cerr << e.what() << std::endl;
+                    return -1;
                 }
             }
-            // catch the exception thrown by the constructor
-            catch(const std::exception& e)
+
+            if(result.empty())
             {
-                std::cerr << e.what() << std::endl;
-                return -1;
+                std::cerr << "No car exists!" << std::endl;
+                manifest.save();
+                return 0;
             }
 
             // utils::visualizeDetection(image, result, classNames);
 
-            // find the detection result with the highest confidence
-            float MaxIndex = 0;
-            for(int i = 1; i < result.size(); i++)
-            {
-                if(result[i].conf > result[MaxIndex].conf)
-                {
-                    MaxIndex = i;
-                }
-            }
-
-            utils::visualizeDetection(image, result[MaxIndex], classNames);
+            // detectTopK returns the detection result with the highest confidence first
+            int MaxIndex = 0;
 
             std::cout << "Left up point: " << result[MaxIndex].box.x << ", " << result[MaxIndex].box.y << std::endl;
             std::cout << "Right down point: " << result[MaxIndex].box.x + result[MaxIndex].box.width << ", " << result[MaxIndex].box.y + result[MaxIndex].box.height << std::endl;
 
+            if (isReused)
+                continue;
 
             //cv::imshow(imagePath, image);
-            cv::imwrite(imagePath, image);
+            // written next to the input, overwriting it would change the file on every run
+            std::string resultPath = "../CL01_WVC/" + std::to_string(i) + "_result.png";
+            if (!renderer.submit(image, {result[MaxIndex]}, resultPath))
+                std::cout << "Render queue full, skipped writing " << resultPath << std::endl;
             cv::waitKey(0);
         }
 
+        manifest.save();
+        std::cout << "Processed: " << manifest.getProcessed() << ", reused: " << manifest.getReused() << std::endl;
+
+        renderer.flush();
+        RenderStats renderStats = renderer.getStats();
+        std::cout << "Written: " << renderStats.written << "/" << renderStats.submitted
+                  << ", dropped: " << renderStats.dropped << std::endl;
+
     #else
         try
         {
@@ -98,7 +131,7 @@ int main(int argc, char* argv[])
             imagePath = "../images/car4.png";
 
             image = cv::imread(imagePath);
-            result = detector.detect(image, confThreshold, iouThreshold);
+            result = detector.detectTopK(image, 1, confThreshold, iouThreshold); // only the most confident car is used
             if(result.empty())
             {
                 std::cerr << "No car exists!" << std::endl;
@@ -113,21 +146,17 @@ int main(int argc, char* argv[])
 
         // utils::visualizeDetection(image, result, classNames);
 
-        // find the detection result with the highest confidence
-        float MaxIndex = 0;
-        for(int i = 1; i < result.size(); i++)
-        {
-            if(result[i].conf > result[MaxIndex].conf)
-            {
-                MaxIndex = i;
-            }
-        }
+        // detectTopK returns the detection result with the highest confidence first
+        int MaxIndex = 0;
 
         utils::visualizeDetection(image, result[MaxIndex], classNames);
 
         std::cout << "Left up point: " << result[MaxIndex].box.x << ", " << result[MaxIndex].box.y << std::endl;
         std::cout << "Right down point: " << result[MaxIndex].box.x + result[MaxIndex].box.width << ", " << result[MaxIndex].box.y + result[MaxIndex].box.height << std::endl;
 
+        MemoryStats memoryStats = detector.memoryStats();
+        std::cout << "Peak RSS: " << memoryStats.peakRssBytes / (1024 * 1024) << " MB" << std::endl;
+
 
         cv::imshow("Result of detection", image);
         // cv::imwrite("result.jpg", image);
@@ -0,0 +1,391 @@
+#include "manifest.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char manifestMagic[4] = {'Y', 'O', 'M', 'F'};
+    const uint32_t manifestVersion = 1;
+
+    const uint64_t fnvOffset = 14695981039346656037ull;
+    const uint64_t fnvPrime = 1099511628211ull;
+
+    uint64_t fnv1a(const void* data, const size_t& size, uint64_t hash = fnvOffset)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= fnvPrime;
+        }
+
+        return hash;
+    }
+}
+
+/**
+ * @brief Open the manifest of a previous run, if it was written with the same configuration
+ * 
+ * @param manifestPath Manifest file, created by save() if it does not exist
+ * @param configHash Hash of the model and thresholds, see hashConfig()
+ */
+ResultsManifest::ResultsManifest(const std::string& manifestPath, const uint64_t& configHash)
+    : manifestPath(manifestPath), configHash(configHash)
+{
+    if (!this->map())
+        std::cout << "No usable manifest at " << manifestPath << ", every file is processed" << std::endl;
+}
+
+ResultsManifest::~ResultsManifest()
+{
+    this->unmap();
+}
+
+/**
+ * @brief FNV-1a hash of the content of a file
+ * 
+ * @param path File path
+ * @return uint64_t 0 if the file cannot be read
+ */
+uint64_t ResultsManifest::hashFile(const std::string& path)
+{
+    return utils::hashFile(path);
+}
+
+/**
+ * @brief Hash of everything the stored detections depend on
+ * 
+ * @param modelPath Path to the onnx model, its content is hashed
+ * @param inputSize Input size of the model
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @return uint64_t 
+ */
+uint64_t ResultsManifest::hashConfig(const std::string& modelPath, const cv::Size& inputSize,
+                                     const float& confThreshold, const float& iouThreshold)
+{
+    uint64_t hash = hashFile(modelPath);
+    hash = fnv1a(&inputSize.width, sizeof(inputSize.width), hash);
+    hash = fnv1a(&inputSize.height, sizeof(inputSize.height), hash);
+    hash = fnv1a(&confThreshold, sizeof(confThreshold), hash);
+    hash = fnv1a(&iouThreshold, sizeof(iouThreshold), hash);
+
+    return hash;
+}
+
+uint64_t ResultsManifest::hashString(const std::string& str)
+{
+    return fnv1a(str.data(), str.size());
+}
+
+/**
+ * @brief Read the size and mtime of a file
+ * 
+ * @param path File path
+ * @param identity Filled with the size and mtime, the content hash is left as is
+ * @return true if the file exists
+ */
+bool ResultsManifest::statFile(const std::string& path, FileIdentity& identity)
+{
+    return utils::statFile(path, identity.size, identity.mtime);
+}
+
+/**
+ * @brief Map the previous manifest and check that it matches the configuration
+ * 
+ * @return true if its entries can be reused
+ */
+bool ResultsManifest::map()
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(manifestPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(Header))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedData = static_cast<const char*>(view);
+    mappedSize = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(manifestPath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(Header))
+    {
+        close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file alive
+    if (view == MAP_FAILED)
+        return false;
+
+    mappedData = static_cast<const char*>(view);
+    mappedSize = (size_t)info.st_size;
+#endif
+
+    Header header;
+    std::memcpy(&header, mappedData, sizeof(Header));
+    size_t expectedSize = sizeof(Header) + header.numRecords * sizeof(Record) +
+                          header.numDetections * sizeof(StoredDetection);
+    if (std::memcmp(header.magic, manifestMagic, sizeof(manifestMagic)) != 0 ||
+        header.version != manifestVersion || header.configHash != configHash ||
+        expectedSize != mappedSize)
+    {
+        this->unmap();
+        return false;
+    }
+
+    records = reinterpret_cast<const Record*>(mappedData + sizeof(Header));
+    numRecords = (size_t)header.numRecords;
+    storedDetections = reinterpret_cast<const StoredDetection*>(records + numRecords);
+    numStoredDetections = (size_t)header.numDetections;
+
+    return true;
+}
+
+void ResultsManifest::unmap()
+{
+    if (mappedData == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(mappedData);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    munmap(const_cast<char*>(mappedData), mappedSize);
+#endif
+
+    mappedData = nullptr;
+    mappedSize = 0;
+    records = nullptr;
+    numRecords = 0;
+    storedDetections = nullptr;
+    numStoredDetections = 0;
+}
+
+/**
+ * @brief Binary search of the previous manifest
+ * 
+ * @param pathHash Hash of the file path
+ * @return const Record* nullptr if the file is not in the manifest
+ */
+const ResultsManifest::Record* ResultsManifest::find(const uint64_t& pathHash) const
+{
+    const Record* end = records + numRecords;
+    const Record* it = std::lower_bound(records, end, pathHash,
+                                        [](const Record& record, const uint64_t& hash) {
+                                            return record.pathHash < hash;
+                                        });
+    if (it == end || it->pathHash != pathHash ||
+        it->firstDetection + it->numDetections > numStoredDetections)
+        return nullptr;
+
+    return it;
+}
+
+/**
+ * @brief Add an entry to the manifest written by save()
+ * 
+ * @param record Entry, its firstDetection is set here
+ * @param detections numDetections detections of the entry
+ */
+void ResultsManifest::append(const Record& record, const StoredDetection* detections)
+{
+    Record newRecord = record;
+    newRecord.firstDetection = newDetections.size();
+    newDetections.insert(newDetections.end(), detections, detections + record.numDetections);
+    newRecords.push_back(newRecord);
+}
+
+/**
+ * @brief Get the stored detections of a file that did not change since the previous run
+ * 
+ * @param imagePath Image file
+ * @param detections Filled with the stored detections on a hit
+ * @return true if the file can be skipped, false if it has to be detected and record()ed
+ */
+bool ResultsManifest::lookup(const std::string& imagePath, std::vector<Detection>& detections)
+{
+    uint64_t pathHash = hashString(imagePath);
+
+    FileIdentity identity;
+    if (!statFile(imagePath, identity))
+        return false;
+
+    const Record* record = this->find(pathHash);
+    if (record != nullptr && (record->size != identity.size || record->mtime != identity.mtime))
+    {
+        // touched or copied, only the content tells if it changed
+        identity.contentHash = hashFile(imagePath);
+        identity.hashed = true;
+        if (identity.size != record->size || identity.contentHash != record->contentHash)
+            record = nullptr;
+    }
+
+    if (record == nullptr || visited.count(pathHash))
+    {
+        identities[pathHash] = identity;
+        return false;
+    }
+
+    const StoredDetection* stored = storedDetections + record->firstDetection;
+    detections.clear();
+    for (size_t i = 0; i < record->numDetections; i++)
+    {
+        Detection detection;
+        detection.box = cv::Rect(stored[i].x, stored[i].y, stored[i].width, stored[i].height);
+        detection.conf = stored[i].conf;
+        detection.classId = stored[i].classId;
+        detections.push_back(detection);
+    }
+
+    Record updated = *record;
+    updated.size = identity.size;
+    updated.mtime = identity.mtime;
+    this->append(updated, stored);
+    visited.insert(pathHash);
+    reused++;
+
+    return true;
+}
+
+/**
+ * @brief Store the detections of a file processed in this run
+ * 
+ * @param imagePath Image file, hashed before it is overwritten
+ * @param detections Detections of the file
+ */
+void ResultsManifest::record(const std::string& imagePath, const std::vector<Detection>& detections)
+{
+    uint64_t pathHash = hashString(imagePath);
+
+    FileIdentity identity;
+    auto known = identities.find(pathHash);
+    if (known != identities.end())
+    {
+        identity = known->second;
+        identities.erase(known);
+    }
+    else if (!statFile(imagePath, identity))
+    {
+        return;
+    }
+    if (!identity.hashed)
+        identity.contentHash = hashFile(imagePath);
+
+    std::vector<StoredDetection> stored;
+    for (const Detection& detection : detections)
+        stored.push_back({detection.box.x, detection.box.y, detection.box.width, detection.box.height,
+                          detection.conf, detection.classId});
+
+    Record record{pathHash, identity.size, identity.mtime, identity.contentHash, 0, stored.size()};
+    this->append(record, stored.data());
+    visited.insert(pathHash);
+    processed++;
+}
+
+/**
+ * @brief Write the manifest of this run, with the unvisited entries of the previous one
+ * 
+ * The file is written next to the manifest and renamed over it.
+ * 
+ * @return true on success
+ */
+bool ResultsManifest::save()
+{
+    // files of other directories or runs keep their entries
+    for (size_t i = 0; i < numRecords; i++)
+    {
+        if (!visited.count(records[i].pathHash) &&
+            records[i].firstDetection + records[i].numDetections <= numStoredDetections)
+            this->append(records[i], storedDetections + records[i].firstDetection);
+    }
+
+    // a path visited twice keeps its last entry
+    std::stable_sort(newRecords.begin(), newRecords.end(), [](const Record& a, const Record& b) {
+        return a.pathHash < b.pathHash;
+    });
+    std::vector<Record> sortedRecords;
+    for (size_t i = 0; i < newRecords.size(); i++)
+    {
+        if (i + 1 < newRecords.size() && newRecords[i + 1].pathHash == newRecords[i].pathHash)
+            continue;
+        sortedRecords.push_back(newRecords[i]);
+    }
+
+    Header header;
+    std::memcpy(header.magic, manifestMagic, sizeof(manifestMagic));
+    header.version = manifestVersion;
+    header.configHash = configHash;
+    header.numRecords = sortedRecords.size();
+    header.numDetections = newDetections.size();
+
+    std::string tmpPath = manifestPath + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        file.write(reinterpret_cast<const char*>(sortedRecords.data()),
+                   (std::streamsize)(sortedRecords.size() * sizeof(Record)));
+        file.write(reinterpret_cast<const char*>(newDetections.data()),
+                   (std::streamsize)(newDetections.size() * sizeof(StoredDetection)));
+        if (!file)
+        {
+            std::cerr << "Failed to write " << tmpPath << std::endl;
+            return false;
+        }
+    }
+
+    // the entries copied above no longer need the old file
+    this->unmap();
+    // replaced in one step, a crash leaves either the old or the new manifest
+#ifdef _WIN32
+    if (!MoveFileExA(tmpPath.c_str(), manifestPath.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else
+    if (std::rename(tmpPath.c_str(), manifestPath.c_str()) != 0)
+#endif
+    {
+        std::cerr << "Failed to replace " << manifestPath << std::endl;
+        return false;
+    }
+
+    newRecords.clear();
+    newDetections.clear();
+    visited.clear();
+    return this->map();
+}
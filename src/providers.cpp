@@ -0,0 +1,201 @@
+#include "providers.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef YOLO_ORT_WITH_DNNL
+#include <dnnl_provider_factory.h>
+#endif
+
+/**
+ * @brief Name of a provider, as used in the provider cache
+ * 
+ * @param provider Execution provider
+ * @return std::string 
+ */
+std::string utils::providerName(const ExecutionProvider& provider)
+{
+    switch (provider)
+    {
+        case ExecutionProvider::Auto: return "auto";
+        case ExecutionProvider::CPU: return "cpu";
+        case ExecutionProvider::XNNPACK: return "xnnpack";
+        case ExecutionProvider::DNNL: return "dnnl";
+        case ExecutionProvider::OpenVINO: return "openvino";
+    }
+
+    return "cpu";
+}
+
+/**
+ * @brief Parse a provider name written by providerName()
+ * 
+ * @param name Provider name
+ * @param provider Set on success
+ * @return true if the name is known
+ */
+bool utils::parseProvider(const std::string& name, ExecutionProvider& provider)
+{
+    for (ExecutionProvider candidate : {ExecutionProvider::Auto, ExecutionProvider::CPU, ExecutionProvider::XNNPACK,
+                                        ExecutionProvider::DNNL, ExecutionProvider::OpenVINO})
+    {
+        if (name == utils::providerName(candidate))
+        {
+            provider = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief CPU-capable providers compiled into the linked ORT build
+ * 
+ * @return std::vector<ExecutionProvider> Always starts with ExecutionProvider::CPU
+ */
+std::vector<ExecutionProvider> utils::getAvailableCpuProviders()
+{
+    std::vector<std::string> availableProviders = Ort::GetAvailableProviders();
+    auto available = [&](const char* name) {
+        return std::find(availableProviders.begin(), availableProviders.end(), name) != availableProviders.end();
+    };
+
+    std::vector<ExecutionProvider> providers {ExecutionProvider::CPU};
+    if (available("XnnpackExecutionProvider"))
+        providers.push_back(ExecutionProvider::XNNPACK);
+#ifdef YOLO_ORT_WITH_DNNL
+    if (available("DnnlExecutionProvider"))
+        providers.push_back(ExecutionProvider::DNNL);
+#endif
+    if (available("OpenVINOExecutionProvider"))
+        providers.push_back(ExecutionProvider::OpenVINO);
+
+    return providers;
+}
+
+/**
+ * @brief Register a provider on the session options, ahead of the default CPU kernels
+ * 
+ * Nodes the provider does not support fall back to the CPU kernels.
+ * 
+ * @param sessionOptions Session options
+ * @param provider Execution provider, CPU adds nothing
+ * @param numThreads Threads of the provider's own pool, 0: its default
+ * @return true if the provider was added or is CPU, false if the linked ORT build lacks it
+ */
+bool utils::appendExecutionProvider(Ort::SessionOptions& sessionOptions, const ExecutionProvider& provider,
+                                    const int& numThreads)
+{
+    std::vector<ExecutionProvider> available = utils::getAvailableCpuProviders();
+    if (std::find(available.begin(), available.end(), provider) == available.end())
+        return false;
+
+    try
+    {
+        return utils::appendAvailableProvider(sessionOptions, provider, numThreads);
+    }
+    catch (const Ort::Exception& e)
+    {
+        std::cerr << "Failed to add " << utils::providerName(provider) << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
+/**
+ * @brief Register a provider listed by getAvailableCpuProviders()
+ * 
+ * @param sessionOptions Session options
+ * @param provider Execution provider
+ * @param numThreads Threads of the provider's own pool, 0: its default
+ * @return true if the provider was added or is CPU
+ * @throws Ort::Exception if ORT rejects the provider
+ */
+bool utils::appendAvailableProvider(Ort::SessionOptions& sessionOptions, const ExecutionProvider& provider,
+                                    const int& numThreads)
+{
+    switch (provider)
+    {
+        case ExecutionProvider::Auto:
+            return false;
+
+        case ExecutionProvider::CPU:
+            return true;
+
+        case ExecutionProvider::XNNPACK:
+        {
+            std::unordered_map<std::string, std::string> providerOptions;
+            if (numThreads > 0)
+                providerOptions["intra_op_num_threads"] = std::to_string(numThreads);
+            sessionOptions.AppendExecutionProvider("XNNPACK", providerOptions);
+            return true;
+        }
+
+        case ExecutionProvider::DNNL:
+#ifdef YOLO_ORT_WITH_DNNL
+            Ort::ThrowOnError(OrtSessionOptionsAppendExecutionProvider_Dnnl(sessionOptions, 1)); // 1: use the arena
+            return true;
+#else
+            return false;
+#endif
+
+        case ExecutionProvider::OpenVINO:
+        {
+            OrtOpenVINOProviderOptions openVINOOptions;
+            openVINOOptions.device_type = "CPU_FP32";
+            if (numThreads > 0)
+                openVINOOptions.num_of_threads = (size_t)numThreads;
+            sessionOptions.AppendExecutionProvider_OpenVINO(openVINOOptions);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Look up the provider picked for a model on this machine
+ * 
+ * @param cachePath Provider cache, one "key provider" pair per line
+ * @param key Model hash, input size and thread count
+ * @param provider Set on a hit
+ * @return true on a hit
+ */
+bool utils::loadCachedProvider(const std::string& cachePath, const std::string& key, ExecutionProvider& provider)
+{
+    std::ifstream file(cachePath);
+    bool found = false;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream stream(line);
+        std::string lineKey, name;
+        ExecutionProvider lineProvider;
+        if (stream >> lineKey >> name && lineKey == key && utils::parseProvider(name, lineProvider))
+        {
+            provider = lineProvider; // later lines win
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * @brief Remember the provider picked for a model on this machine
+ * 
+ * @param cachePath Provider cache, created if needed
+ * @param key Model hash, input size and thread count
+ * @param provider Picked provider
+ */
+void utils::storeCachedProvider(const std::string& cachePath, const std::string& key,
+                                const ExecutionProvider& provider)
+{
+    std::ofstream file(cachePath, std::ios::app);
+    file << key << " " << utils::providerName(provider) << std::endl;
+    if (!file)
+        std::cerr << "Failed to write the provider cache " << cachePath << std::endl;
+}
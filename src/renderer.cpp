@@ -0,0 +1,179 @@
+#include "renderer.h"
+
+/**
+ * @brief Construct a new AsyncRenderer object
+ * 
+ * @param classNames Vector of class names
+ * @param numWorkers Number of render/encode workers
+ * @param queueCapacity Maximum number of frames waiting or in progress
+ * @param encoderOptions JPEG quality and PNG compression level
+ */
+AsyncRenderer::AsyncRenderer(const std::vector<std::string>& classNames,
+                             const int& numWorkers,
+                             const int& queueCapacity,
+                             const EncoderOptions& encoderOptions)
+    : classNames(classNames), queueCapacity(std::max(queueCapacity, 1)),
+      encoderOptions(encoderOptions), pool(numWorkers)
+{
+}
+
+/**
+ * @brief Write the frames still queued, then stop the workers
+ */
+AsyncRenderer::~AsyncRenderer()
+{
+    this->flush();
+}
+
+/**
+ * @brief Queue an image to be annotated and written, without blocking
+ * 
+ * The image is not copied, pass image.clone() if its buffer is reused for the next frame.
+ * 
+ * @param image Image to draw on
+ * @param detections Vector of detections
+ * @param outputPath Output file, the extension selects the encoder
+ * @return true if queued, false if dropped because the queue is full
+ */
+bool AsyncRenderer::submit(cv::Mat image, const std::vector<Detection>& detections, const std::string& outputPath)
+{
+    submitted++;
+    if (pending.fetch_add(1) >= queueCapacity)
+    {
+        pending--;
+        dropped++;
+        return false;
+    }
+
+    pool.enqueue([this, image, detections, outputPath]() mutable {
+        try
+        {
+            this->render(image, detections);
+            if (cv::imwrite(outputPath, image, this->encoderParams(outputPath)))
+                written++;
+            else
+                failed++;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Failed to write " << outputPath << ": " << e.what() << std::endl;
+            failed++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(flushMutex);
+            pending--;
+        }
+        flushCondition.notify_all();
+    });
+
+    return true;
+}
+
+/**
+ * @brief Wait until every queued frame is written
+ */
+void AsyncRenderer::flush()
+{
+    std::unique_lock<std::mutex> lock(flushMutex);
+    flushCondition.wait(lock, [this]() { return pending.load() == 0; });
+}
+
+/**
+ * @brief Get the submit/drop/write counters
+ * 
+ * @return RenderStats 
+ */
+RenderStats AsyncRenderer::getStats() const
+{
+    RenderStats stats;
+    stats.submitted = submitted.load();
+    stats.dropped = dropped.load();
+    stats.written = written.load();
+    stats.failed = failed.load();
+
+    return stats;
+}
+
+/**
+ * @brief Get the encoder parameters of an output file
+ * 
+ * @param outputPath Output file
+ * @return std::vector<int> cv::imwrite parameters
+ */
+std::vector<int> AsyncRenderer::encoderParams(const std::string& outputPath) const
+{
+    std::string extension = outputPath.substr(outputPath.find_last_of('.') + 1);
+    for (char& c : extension)
+        c = (char)std::tolower((unsigned char)c);
+
+    if (extension == "jpg" || extension == "jpeg")
+        return {cv::IMWRITE_JPEG_QUALITY, encoderOptions.jpegQuality};
+    if (extension == "png")
+        return {cv::IMWRITE_PNG_COMPRESSION, encoderOptions.pngCompression};
+
+    return {};
+}
+
+/**
+ * @brief Get the pre-rendered label of a class and confidence bucket
+ * 
+ * Same look as utils::visualizeDetection.
+ * 
+ * @param classId Class id
+ * @param confPercent Confidence in percent
+ * @return cv::Mat Label image, shared between frames, read only
+ */
+cv::Mat AsyncRenderer::getSprite(const int& classId, const int& confPercent)
+{
+    std::pair<int, int> key(classId, confPercent);
+    {
+        std::lock_guard<std::mutex> lock(spriteMutex);
+        auto it = sprites.find(key);
+        if (it != sprites.end())
+            return it->second;
+    }
+
+    std::string name = classId >= 0 && classId < (int)classNames.size() ? classNames[classId]
+                                                                        : std::to_string(classId);
+    std::string label = name + " 0." + std::to_string(confPercent);
+
+    int baseline = 0;
+    cv::Size size = cv::getTextSize(label, cv::FONT_ITALIC, 0.8, 2, &baseline); // get text size
+    cv::Mat sprite(25, size.width, CV_8UC3, cv::Scalar(229, 160, 21));
+    cv::putText(sprite, label,
+                cv::Point(0, 22), cv::FONT_ITALIC,
+                0.8, cv::Scalar(255, 255, 255), 2);
+
+    std::lock_guard<std::mutex> lock(spriteMutex);
+    sprites[key] = sprite;
+
+    return sprite;
+}
+
+/**
+ * @brief Draw the boxes and paste the cached labels
+ * 
+ * @param image Image to draw on
+ * @param detections Vector of detections
+ */
+void AsyncRenderer::render(cv::Mat& image, const std::vector<Detection>& detections)
+{
+    cv::Rect imageRect(0, 0, image.cols, image.rows);
+
+    for (const Detection& detection : detections)
+    {
+        cv::rectangle(image, detection.box, cv::Scalar(229, 160, 21), 2); // draw bounding box
+
+        cv::Mat sprite = this->getSprite(detection.classId, (int)std::round(detection.conf * 100));
+
+        // label sits on top of the box, clipped to the image
+        cv::Rect labelRect(detection.box.x, detection.box.y - sprite.rows, sprite.cols, sprite.rows);
+        cv::Rect visible = labelRect & imageRect;
+        if (visible.area() <= 0)
+            continue;
+
+        cv::Rect spriteRect(visible.x - labelRect.x, visible.y - labelRect.y, visible.width, visible.height);
+        sprite(spriteRect).copyTo(image(visible));
+    }
+}
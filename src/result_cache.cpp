@@ -0,0 +1,221 @@
+#include "result_cache.h"
+
+/**
+ * @brief Construct a new CachedDetector object
+ * 
+ * @param detector Detector run on cache misses
+ * @param options Hash, near-duplicate tolerance and memory bound
+*/
+CachedDetector::CachedDetector(YOLODetector& detector, const ResultCacheOptions& options)
+    : detector(detector), options(options)
+{
+}
+
+/**
+ * @brief Hash an image with the configured hash
+ * 
+ * @param image Input image
+ * @return uint64_t 
+ */
+uint64_t CachedDetector::hashImage(const cv::Mat& image) const
+{
+    return options.hash == ImageHash::Perceptual ? utils::perceptualHash(image)
+                                                 : utils::differenceHash(image);
+}
+
+/**
+ * @brief Find the entry of an identical or near-identical frame
+ * 
+ * @param hash Hash of the frame
+ * @param aspect Aspect ratio of the frame
+ * @param confThreshold Confidence threshold the entry must have been detected with
+ * @param iouThreshold IOU threshold the entry must have been detected with
+ * @return std::list<Entry>::iterator entries.end() if there is none
+ */
+std::list<CachedDetector::Entry>::iterator CachedDetector::find(const uint64_t& hash, const float& aspect,
+                                                                const float& confThreshold,
+                                                                const float& iouThreshold)
+{
+    auto usable = [&](const Entry& entry) {
+        return entry.confThreshold == confThreshold && entry.iouThreshold == iouThreshold &&
+               std::abs(entry.aspect - aspect) <= options.maxAspectChange * aspect;
+    };
+
+    auto exact = index.find(hash);
+    if (exact != index.end() && usable(*exact->second))
+        return exact->second;
+    if (options.maxHammingDistance <= 0)
+        return entries.end();
+
+    // a scan of 64-bit hashes, cheap next to a detect even for thousands of entries
+    auto best = entries.end();
+    int bestDistance = options.maxHammingDistance + 1;
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+    {
+        int distance = utils::hammingDistance(hash, it->hash);
+        if (distance < bestDistance && usable(*it))
+        {
+            best = it;
+            bestDistance = distance;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @brief Store the detections of a frame as the most recently used entry
+ * 
+ * @param hash Hash of the frame
+ * @param aspect Aspect ratio of the frame
+ * @param imageShape Size of the frame
+ * @param confThreshold Confidence threshold of the detections
+ * @param iouThreshold IOU threshold of the detections
+ * @param detections Detections of the frame
+ */
+void CachedDetector::insert(const uint64_t& hash, const float& aspect, const cv::Size& imageShape,
+                            const float& confThreshold, const float& iouThreshold,
+                            const std::vector<Detection>& detections)
+{
+    auto existing = index.find(hash);
+    if (existing != index.end())
+    {
+        bytes -= existing->second->bytes;
+        entries.erase(existing->second);
+        index.erase(existing);
+    }
+
+    Entry entry;
+    entry.hash = hash;
+    entry.aspect = aspect;
+    entry.confThreshold = confThreshold;
+    entry.iouThreshold = iouThreshold;
+    for (const Detection& detection : detections)
+    {
+        cv::Rect2f box((float)detection.box.x / (float)imageShape.width,
+                       (float)detection.box.y / (float)imageShape.height,
+                       (float)detection.box.width / (float)imageShape.width,
+                       (float)detection.box.height / (float)imageShape.height);
+        entry.boxes.push_back({box, detection.conf, detection.classId});
+    }
+    entry.boxes.shrink_to_fit();
+
+    // list node, index node and the boxes
+    entry.bytes = sizeof(Entry) + 2 * sizeof(void*) +
+                  sizeof(std::pair<uint64_t, std::list<Entry>::iterator>) + 2 * sizeof(void*) +
+                  entry.boxes.capacity() * sizeof(CachedBox);
+
+    bytes += entry.bytes;
+    entries.push_front(std::move(entry));
+    index[hash] = entries.begin();
+
+    this->evict();
+}
+
+/**
+ * @brief Drop the least recently used entries until the cache fits in maxBytes
+ */
+void CachedDetector::evict()
+{
+    while (bytes > options.maxBytes && !entries.empty())
+    {
+        const Entry& oldest = entries.back();
+        bytes -= oldest.bytes;
+        index.erase(oldest.hash);
+        entries.pop_back();
+    }
+}
+
+/**
+ * @brief Detect objects in the image, or return the detections of a duplicate frame
+ * 
+ * @param image Input image
+ * @param confThreshold Confidence threshold
+ * @param iouThreshold IOU threshold
+ * @return std::vector<Detection> 
+*/
+std::vector<Detection> CachedDetector::detect(cv::Mat &image, const float& confThreshold,
+                                              const float& iouThreshold)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    uint64_t hash = this->hashImage(image);
+    float aspect = (float)image.cols / (float)image.rows;
+    stats.lookups++;
+
+    auto entry = this->find(hash, aspect, confThreshold, iouThreshold);
+    if (entry != entries.end())
+    {
+        entries.splice(entries.begin(), entries, entry); // now the most recently used
+
+        std::vector<Detection> detections;
+        for (const CachedBox& cached : entry->boxes)
+        {
+            Detection detection;
+            detection.box = cv::Rect((int)std::round(cached.box.x * (float)image.cols),
+                                     (int)std::round(cached.box.y * (float)image.rows),
+                                     (int)std::round(cached.box.width * (float)image.cols),
+                                     (int)std::round(cached.box.height * (float)image.rows));
+            detection.conf = cached.conf;
+            detection.classId = cached.classId;
+            detections.push_back(detection);
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        stats.hits++;
+        if (misses > 0)
+        {
+            double hitMs = std::chrono::duration<double, std::milli>(end - start).count();
+            stats.savedMs += std::max(0.0, missTimeMs / (double)misses - hitMs);
+        }
+
+        return detections;
+    }
+
+    std::vector<Detection> detections = detector.detect(image, confThreshold, iouThreshold);
+    this->insert(hash, aspect, image.size(), confThreshold, iouThreshold, detections);
+
+    auto end = std::chrono::steady_clock::now();
+    misses++;
+    missTimeMs += std::chrono::duration<double, std::milli>(end - start).count();
+
+    return detections;
+}
+
+/**
+ * @brief Drop all entries, the counters are kept
+ */
+void CachedDetector::clear()
+{
+    entries.clear();
+    index.clear();
+    bytes = 0;
+}
+
+/**
+ * @brief Get the hit counters and the current size of the cache
+ * 
+ * @return ResultCacheStats 
+ */
+ResultCacheStats CachedDetector::getStats() const
+{
+    ResultCacheStats current = stats;
+    current.entries = entries.size();
+    current.bytes = bytes;
+
+    return current;
+}
+
+/**
+ * @brief Print the hit rate, the time saved and the size of the cache
+ * 
+ * @param os Output stream
+ */
+void CachedDetector::printStats(std::ostream& os) const
+{
+    ResultCacheStats current = this->getStats();
+    os << "Cache hit rate: " << current.hitRate() * 100.0 << "%"
+       << " (" << current.hits << "/" << current.lookups << ")" << std::endl;
+    os << "Time saved: " << current.savedMs << " ms" << std::endl;
+    os << "Cache entries: " << current.entries << ", " << current.bytes << " bytes" << std::endl;
+}
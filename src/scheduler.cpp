@@ -0,0 +1,247 @@
+#include "scheduler.h"
+
+/**
+ * @brief Construct a new StreamScheduler object and start its thread
+ * 
+ * @param detector Detector shared by all streams, only used by the scheduler thread
+ * @param config Batch size, batching delay and thresholds
+ * @param callback Called with the detections of every processed frame
+*/
+StreamScheduler::StreamScheduler(YOLODetector& detector, const SchedulerConfig& config,
+                                 const ResultCallback& callback)
+    : detector(detector), config(config), callback(callback)
+{
+    if (!detector.supportsBatch())
+        std::cout << "Fixed batch size model, batches run frame by frame" << std::endl;
+
+    thread = std::thread(&StreamScheduler::loop, this);
+}
+
+/**
+ * @brief Stop the scheduler, queued frames are discarded
+ */
+StreamScheduler::~StreamScheduler()
+{
+    this->stop();
+}
+
+/**
+ * @brief Stop the scheduler thread after its current batch
+ */
+void StreamScheduler::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    if (thread.joinable())
+        thread.join();
+}
+
+/**
+ * @brief Register a stream
+ * 
+ * @param config Weight, staleness limit and queue size of the stream
+ * @return int Id of the stream
+ */
+int StreamScheduler::addStream(const StreamConfig& config)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Stream stream;
+    stream.config = config;
+    stream.config.weight = std::max(config.weight, 1);
+    stream.config.queueCapacity = std::max(config.queueCapacity, (size_t)1);
+    stream.added = Clock::now();
+    streams.push_back(stream);
+
+    return (int)streams.size() - 1;
+}
+
+/**
+ * @brief Queue a frame of a stream, without blocking
+ * 
+ * The frame is not copied, pass frame.clone() if its buffer is reused.
+ * 
+ * @param streamId Id returned by addStream()
+ * @param frame Frame to detect
+ * @return true if queued without dropping an older frame
+ */
+bool StreamScheduler::submit(const int& streamId, const cv::Mat& frame)
+{
+    bool dropped = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stream& stream = streams.at(streamId);
+
+        stream.stats.submitted++;
+        if (stream.queue.size() >= stream.config.queueCapacity)
+        {
+            stream.queue.pop_front(); // drop the oldest, the newest frame matters most
+            stream.stats.droppedOverflow++;
+            queuedFrames--;
+            dropped = true;
+        }
+
+        stream.queue.push_back({frame, Clock::now()});
+        queuedFrames++;
+    }
+    condition.notify_all();
+
+    return !dropped;
+}
+
+/**
+ * @brief Pick the frames of the next batch by deficit round-robin
+ * 
+ * Every visit adds the weight of a stream to its deficit and each frame taken
+ * costs one, so over time streams get frames in proportion to their weights.
+ * Stale frames are dropped on the way. Called with the mutex held.
+ * 
+ * @return std::vector<std::pair<int, Frame>> (stream id, frame) pairs
+ */
+std::vector<std::pair<int, StreamScheduler::Frame>> StreamScheduler::takeBatch()
+{
+    std::vector<std::pair<int, Frame>> batch;
+    Clock::time_point now = Clock::now();
+
+    while ((int)batch.size() < config.maxBatchSize && queuedFrames > 0)
+    {
+        Stream& stream = streams[nextStream];
+
+        while (!stream.queue.empty() && now - stream.queue.front().submitted > stream.config.maxStaleness)
+        {
+            stream.queue.pop_front();
+            stream.stats.droppedStale++;
+            queuedFrames--;
+        }
+
+        if (stream.queue.empty())
+        {
+            stream.deficit = 0; // idle streams do not bank credit
+            nextStream = (nextStream + 1) % streams.size();
+            continue;
+        }
+
+        if (stream.deficit <= 0)
+            stream.deficit += stream.config.weight;
+
+        while (stream.deficit > 0 && !stream.queue.empty() && (int)batch.size() < config.maxBatchSize)
+        {
+            batch.emplace_back((int)nextStream, stream.queue.front());
+            stream.queue.pop_front();
+            stream.deficit--;
+            queuedFrames--;
+        }
+
+        // a stream keeps its turn while the batch is full and it has credit left
+        if (stream.deficit <= 0 || stream.queue.empty())
+            nextStream = (nextStream + 1) % streams.size();
+    }
+
+    return batch;
+}
+
+void StreamScheduler::loop()
+{
+    while (true)
+    {
+        std::vector<std::pair<int, Frame>> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || queuedFrames > 0; });
+            if (stopping)
+                return;
+
+            // give the other streams a moment to fill the batch
+            condition.wait_for(lock, config.maxBatchDelay, [this]() {
+                return stopping || (int)queuedFrames >= config.maxBatchSize;
+            });
+            if (stopping)
+                return;
+
+            batch = this->takeBatch();
+        }
+        if (batch.empty())
+            continue;
+
+        std::vector<cv::Mat> images;
+        for (const std::pair<int, Frame>& item : batch)
+            images.push_back(item.second.image);
+
+        std::vector<std::vector<Detection>> results;
+        try
+        {
+            results = detector.detectBatch(images, config.confThreshold, config.iouThreshold);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Batch of " << batch.size() << " frames failed: " << e.what() << std::endl;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const std::pair<int, Frame>& item : batch)
+                streams[item.first].stats.droppedFailed++;
+            continue;
+        }
+
+        Clock::time_point done = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const std::pair<int, Frame>& item : batch)
+            {
+                StreamStats& stats = streams[item.first].stats;
+                double latencyMs = std::chrono::duration<double, std::milli>(done - item.second.submitted).count();
+                stats.processed++;
+                stats.totalLatencyMs += latencyMs;
+                stats.maxLatencyMs = std::max(stats.maxLatencyMs, latencyMs);
+            }
+        }
+
+        for (size_t i = 0; i < batch.size(); i++)
+            callback(batch[i].first, batch[i].second.image, results[i]);
+    }
+}
+
+/**
+ * @brief Get the counters of a stream
+ * 
+ * @param streamId Id returned by addStream()
+ * @return StreamStats 
+ */
+StreamStats StreamScheduler::getStats(const int& streamId) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const Stream& stream = streams.at(streamId);
+
+    StreamStats stats = stream.stats;
+    stats.elapsedSeconds = std::chrono::duration<double>(Clock::now() - stream.added).count();
+
+    return stats;
+}
+
+/**
+ * @brief Print the throughput, latency and drops of every stream
+ * 
+ * @param os Output stream
+ */
+void StreamScheduler::printStats(std::ostream& os) const
+{
+    size_t numStreams;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        numStreams = streams.size();
+    }
+
+    for (size_t i = 0; i < numStreams; i++)
+    {
+        StreamStats stats = this->getStats((int)i);
+        os << "Stream " << i << ": " << stats.fps() << " fps"
+           << ", latency mean " << stats.meanLatencyMs() << " ms, max " << stats.maxLatencyMs << " ms"
+           << ", processed " << stats.processed << "/" << stats.submitted
+           << ", dropped " << stats.droppedOverflow << " overflow, " << stats.droppedStale << " stale, "
+           << stats.droppedFailed << " failed"
+           << std::endl;
+    }
+}
@@ -0,0 +1,69 @@
+#include "thread_pool.h"
+#include "utils.h"
+
+/**
+ * @brief Start the workers
+ * 
+ * @param numThreads Number of workers
+ * @param cpus Cpus the workers are pinned to, empty: not pinned
+ */
+ThreadPool::ThreadPool(const int& numThreads, const std::vector<int>& cpus)
+{
+    for (int i = 0; i < std::max(numThreads, 1); i++)
+    {
+        workers.emplace_back([this, cpus]() {
+            if (!cpus.empty())
+                utils::setThreadAffinity(cpus);
+
+            while (true)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                    if (stopping && tasks.empty())
+                        return;
+
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                }
+                task();
+            }
+        });
+    }
+}
+
+/**
+ * @brief Finish the queued tasks and join the workers
+ */
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+/**
+ * @brief Run task(0) ... task(numTasks - 1) on the workers and wait for all of them
+ * 
+ * @param numTasks Number of tasks
+ * @param task Task taking its index
+ */
+void ThreadPool::parallelFor(const int& numTasks, const std::function<void(int)>& task)
+{
+    std::vector<std::future<void>> futures;
+    futures.reserve(numTasks);
+    for (int i = 0; i < numTasks; i++)
+        futures.push_back(this->enqueue([&task, i]() { task(i); }));
+
+    // wait for every task before get() rethrows a failure, the tasks reference task
+    for (std::future<void>& future : futures)
+        future.wait();
+    for (std::future<void>& future : futures)
+        future.get();
+}
@@ -1,5 +1,15 @@
 #include "utils.h"
 
+#include <sys/stat.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 /**
  * @brief Calculate the product of a vector
  * 
@@ -222,6 +232,319 @@ void utils::scaleCoords(const cv::Size& imageShape,
     // coords.height = utils::clip(coords.height, 0, imageOriginalShape.height);
 }
 
+/**
+ * @brief Intersection over union of two boxes
+ * 
+ * @param box1 First box
+ * @param box2 Second box
+ * @return float IoU in [0, 1]
+ */
+float utils::computeIoU(const cv::Rect& box1, const cv::Rect& box2)
+{
+    int interArea = (box1 & box2).area();
+    int unionArea = box1.area() + box2.area() - interArea;
+    if (unionArea <= 0)
+        return 0.0f;
+
+    return (float)interArea / (float)unionArea;
+}
+
+/**
+ * @brief Get the current and peak resident memory of the process
+ * 
+ * @param rssBytes Resident set size in bytes, 0 if unknown
+ * @param peakRssBytes Peak resident set size in bytes, 0 if unknown
+ */
+void utils::getMemoryUsage(size_t& rssBytes, size_t& peakRssBytes)
+{
+    rssBytes = 0;
+    peakRssBytes = 0;
+
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        rssBytes = counters.WorkingSetSize;
+        peakRssBytes = counters.PeakWorkingSetSize;
+    }
+#else
+    // VmRSS and VmHWM are reported in kB
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            rssBytes = std::stoul(line.substr(6)) * 1024;
+        else if (line.compare(0, 6, "VmHWM:") == 0)
+            peakRssBytes = std::stoul(line.substr(6)) * 1024;
+    }
+#endif
+}
+
+/**
+ * @brief Get the number of NUMA nodes of the machine
+ * 
+ * @return int Number of nodes, 1 if the machine is not NUMA or unknown
+ */
+int utils::getNumaNodeCount()
+{
+#ifdef _WIN32
+    ULONG highestNode = 0;
+    if (GetNumaHighestNodeNumber(&highestNode))
+        return (int)highestNode + 1;
+
+    return 1;
+#else
+    int count = 0;
+    while (std::ifstream("/sys/devices/system/node/node" + std::to_string(count) + "/cpulist").good())
+        count++;
+
+    return std::max(count, 1);
+#endif
+}
+
+/**
+ * @brief Get the cpus of a NUMA node
+ * 
+ * @param node NUMA node
+ * @return std::vector<int> Cpu ids, empty if unknown
+ */
+std::vector<int> utils::getNumaNodeCpus(const int& node)
+{
+    std::vector<int> cpus;
+
+#ifdef _WIN32
+    ULONGLONG mask = 0;
+    if (GetNumaNodeProcessorMask((UCHAR)node, &mask))
+    {
+        for (int cpu = 0; cpu < 64; cpu++)
+        {
+            if (mask & (1ULL << cpu))
+                cpus.push_back(cpu);
+        }
+    }
+#else
+    // cpulist looks like "0-15,32-47"
+    std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string range;
+    while (std::getline(cpulist, range, ','))
+    {
+        size_t dash = range.find('-');
+        try
+        {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        }
+        catch (const std::exception&)
+        {
+            // trailing newline or empty list
+        }
+    }
+#endif
+
+    return cpus;
+}
+
+/**
+ * @brief Pin the calling thread to a set of cpus
+ * 
+ * @param cpus Cpu ids
+ * @return true on success
+ */
+bool utils::setThreadAffinity(const std::vector<int>& cpus)
+{
+    if (cpus.empty())
+        return false;
+
+#ifdef _WIN32
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus)
+    {
+        if (cpu < (int)(8 * sizeof(DWORD_PTR)))
+            mask |= (DWORD_PTR)1 << cpu;
+    }
+
+    return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &cpuSet);
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+#endif
+}
+
+/**
+ * @brief Read the size and mtime of a file
+ * 
+ * @param path File path
+ * @param size Size in bytes
+ * @param mtime Last modification, seconds since the epoch
+ * @return true if the file exists
+ */
+bool utils::statFile(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(path.c_str(), &info) != 0)
+        return false;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+#endif
+
+    size = (uint64_t)info.st_size;
+    mtime = (int64_t)info.st_mtime;
+    return true;
+}
+
+/**
+ * @brief FNV-1a hash of the content of a file
+ * 
+ * @param path File path
+ * @return uint64_t 0 if the file cannot be read
+ */
+uint64_t utils::hashFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return 0;
+
+    uint64_t hash = 14695981039346656037ull;
+    std::vector<char> buffer(1 << 16);
+    while (file)
+    {
+        file.read(buffer.data(), (std::streamsize)buffer.size());
+        for (std::streamsize i = 0; i < file.gcount(); i++)
+        {
+            hash ^= (unsigned char)buffer[i];
+            hash *= 1099511628211ull;
+        }
+    }
+
+    return hash;
+}
+
+/**
+ * @brief 64-bit dHash: sign of the horizontal gradients of a 9x8 grayscale thumbnail
+ * 
+ * Robust to scaling, recompression and small brightness changes.
+ * 
+ * @param image 8-bit BGR or grayscale image
+ * @return uint64_t Hash, compare with hammingDistance()
+ */
+uint64_t utils::differenceHash(const cv::Mat& image)
+{
+    // shrink first, so only the thumbnail is converted
+    cv::Mat thumbnail, gray;
+    cv::resize(image, thumbnail, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+    if (thumbnail.channels() == 3)
+        cv::cvtColor(thumbnail, gray, cv::COLOR_BGR2GRAY);
+    else
+        gray = thumbnail;
+
+    uint64_t hash = 0;
+    for (int y = 0; y < 8; y++)
+    {
+        const uchar* row = gray.ptr<uchar>(y);
+        for (int x = 0; x < 8; x++)
+            hash = (hash << 1) | (uint64_t)(row[x] < row[x + 1]);
+    }
+
+    return hash;
+}
+
+/**
+ * @brief 64-bit pHash: low frequency DCT coefficients of a 32x32 thumbnail against their median
+ * 
+ * Slower than differenceHash(), but more tolerant to noise and gamma changes.
+ * 
+ * @param image 8-bit BGR or grayscale image
+ * @return uint64_t Hash, compare with hammingDistance()
+ */
+uint64_t utils::perceptualHash(const cv::Mat& image)
+{
+    cv::Mat thumbnail, gray, grayFloat, frequencies;
+    cv::resize(image, thumbnail, cv::Size(32, 32), 0, 0, cv::INTER_AREA);
+    if (thumbnail.channels() == 3)
+        cv::cvtColor(thumbnail, gray, cv::COLOR_BGR2GRAY);
+    else
+        gray = thumbnail;
+    gray.convertTo(grayFloat, CV_32F);
+    cv::dct(grayFloat, frequencies);
+
+    // top-left 8x8 block, the DC term is left out of the median
+    std::vector<float> coefficients;
+    coefficients.reserve(64);
+    for (int y = 0; y < 8; y++)
+    {
+        const float* row = frequencies.ptr<float>(y);
+        for (int x = 0; x < 8; x++)
+            coefficients.push_back(row[x]);
+    }
+
+    std::vector<float> acTerms(coefficients.begin() + 1, coefficients.end());
+    std::nth_element(acTerms.begin(), acTerms.begin() + acTerms.size() / 2, acTerms.end());
+    float median = acTerms[acTerms.size() / 2];
+
+    uint64_t hash = 0;
+    for (float coefficient : coefficients)
+        hash = (hash << 1) | (uint64_t)(coefficient > median);
+
+    return hash;
+}
+
+/**
+ * @brief Number of differing bits of two hashes
+ * 
+ * @param hash1 First hash
+ * @param hash2 Second hash
+ * @return int Distance in [0, 64]
+ */
+int utils::hammingDistance(const uint64_t& hash1, const uint64_t& hash2)
+{
+    uint64_t bits = hash1 ^ hash2;
+    int distance = 0;
+    while (bits)
+    {
+        bits &= bits - 1; // clear the lowest set bit
+        distance++;
+    }
+
+    return distance;
+}
+
+/**
+ * @brief Logistic sigmoid
+ * 
+ * @param x Logit
+ * @return float Probability in (0, 1)
+ */
+float utils::sigmoid(const float& x)
+{
+    return 1.0f / (1.0f + std::exp(-x));
+}
+
+/**
+ * @brief Inverse of the sigmoid, used to compare thresholds against raw logits
+ * 
+ * @param p Probability
+ * @return float Logit, +-infinity outside of (0, 1)
+ */
+float utils::logit(const float& p)
+{
+    if (p <= 0.0f)
+        return -std::numeric_limits<float>::infinity();
+    if (p >= 1.0f)
+        return std::numeric_limits<float>::infinity();
+
+    return std::log(p / (1.0f - p));
+}
+
 // void utils::scaleCoords(const cv::Size& imgShape,
 //                         cv::Rect& coords,
 //                         const cv::Size& oriImgShape)
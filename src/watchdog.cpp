@@ -0,0 +1,74 @@
+#include "watchdog.h"
+
+/**
+ * @brief Start the watchdog thread
+ */
+RunWatchdog::RunWatchdog()
+{
+    thread = std::thread(&RunWatchdog::loop, this);
+}
+
+/**
+ * @brief Stop and join the watchdog thread
+ */
+RunWatchdog::~RunWatchdog()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    thread.join();
+}
+
+/**
+ * @brief Watch a run, SetTerminate() is called on its options at the deadline
+ * 
+ * @param runOptions Options passed to Session::Run, must stay alive until disarm()
+ * @param deadline Deadline of the run
+ */
+void RunWatchdog::arm(Ort::RunOptions& runOptions, const std::chrono::steady_clock::time_point& deadline)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->runOptions = &runOptions;
+        this->deadline = deadline;
+        this->fired = false;
+    }
+    condition.notify_all();
+}
+
+/**
+ * @brief Stop watching the current run
+ * 
+ * @return true if the run was terminated
+ */
+bool RunWatchdog::disarm()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->runOptions = nullptr;
+    condition.notify_all();
+
+    return fired;
+}
+
+void RunWatchdog::loop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping)
+    {
+        if (runOptions == nullptr || fired)
+        {
+            condition.wait(lock);
+            continue;
+        }
+
+        // woken early by disarm() or a new arm(), otherwise the deadline passed
+        if (condition.wait_until(lock, deadline) == std::cv_status::timeout &&
+            runOptions != nullptr && !fired && std::chrono::steady_clock::now() >= deadline)
+        {
+            runOptions->SetTerminate();
+            fired = true;
+        }
+    }
+}
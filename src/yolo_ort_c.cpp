@@ -0,0 +1,176 @@
+#include "yolo_ort_c.h"
+#include "detector.h"
+
+struct yolo_ort_detector
+{
+    YOLODetector detector{nullptr};
+};
+
+static thread_local std::string lastError;
+
+/**
+ * @brief Wrap a C image without copying its pixels
+ * 
+ * @param image C image
+ * @return cv::Mat 8-bit BGR image sharing the caller's buffer
+ */
+static cv::Mat wrapImage(const yolo_ort_image* image)
+{
+    if (image == nullptr || image->data == nullptr || image->width <= 0 || image->height <= 0)
+        throw std::invalid_argument("invalid image");
+
+    size_t stride = image->stride > 0 ? (size_t)image->stride : (size_t)image->width * 3;
+
+    // detect() only reads the image
+    return cv::Mat(image->height, image->width, CV_8UC3, const_cast<unsigned char*>(image->data), stride);
+}
+
+/**
+ * @brief Copy detections into a caller buffer
+ * 
+ * @return int Number of detections, which may exceed capacity
+ */
+static int copyDetections(const std::vector<Detection>& result, yolo_ort_detection* detections, int capacity)
+{
+    int count = (int)result.size();
+    for (int i = 0; i < std::min(count, capacity); i++)
+    {
+        detections[i].x = result[i].box.x;
+        detections[i].y = result[i].box.y;
+        detections[i].width = result[i].box.width;
+        detections[i].height = result[i].box.height;
+        detections[i].conf = result[i].conf;
+        detections[i].class_id = result[i].classId;
+    }
+
+    return count;
+}
+
+yolo_ort_detector* yolo_ort_create(const char* model_path, int use_gpu, int input_width, int input_height)
+{
+    try
+    {
+        if (model_path == nullptr)
+            throw std::invalid_argument("model_path is NULL");
+
+        auto* handle = new yolo_ort_detector;
+        try
+        {
+            handle->detector = YOLODetector(model_path, use_gpu != 0, cv::Size(input_width, input_height));
+        }
+        catch (...)
+        {
+            delete handle;
+            throw;
+        }
+        return handle;
+    }
+    catch (const std::exception& e)
+    {
+        lastError = e.what();
+        return nullptr;
+    }
+    catch (...)
+    {
+        lastError = "unknown error";
+        return nullptr;
+    }
+}
+
+void yolo_ort_destroy(yolo_ort_detector* detector)
+{
+    delete detector;
+}
+
+int yolo_ort_detect(yolo_ort_detector* detector, const yolo_ort_image* image,
+                    float conf_threshold, float iou_threshold,
+                    yolo_ort_detection* detections, int capacity)
+{
+    try
+    {
+        if (detector == nullptr || (detections == nullptr && capacity > 0))
+            throw std::invalid_argument("invalid detector or detection buffer");
+
+        cv::Mat frame = wrapImage(image);
+        std::vector<Detection> result = detector->detector.detect(frame, conf_threshold, iou_threshold);
+
+        return copyDetections(result, detections, capacity);
+    }
+    catch (const std::exception& e)
+    {
+        lastError = e.what();
+        return -1;
+    }
+    catch (...)
+    {
+        lastError = "unknown error";
+        return -1;
+    }
+}
+
+int yolo_ort_detect_batch(yolo_ort_detector* detector, const yolo_ort_image* images,
+                          int num_images, float conf_threshold, float iou_threshold,
+                          yolo_ort_detection* detections, int capacity_per_image,
+                          int* counts)
+{
+    try
+    {
+        if (detector == nullptr || images == nullptr || counts == nullptr || num_images < 0 ||
+            (detections == nullptr && capacity_per_image > 0))
+            throw std::invalid_argument("invalid detector, images, detection buffer or counts");
+
+        // an invalid image fails alone, the others still go through detectBatch
+        int status = 0;
+        std::vector<cv::Mat> frames;
+        std::vector<int> frameIndices;
+        for (int i = 0; i < num_images; i++)
+        {
+            counts[i] = -1;
+            try
+            {
+                frames.push_back(wrapImage(&images[i]));
+                frameIndices.push_back(i);
+            }
+            catch (const std::exception& e)
+            {
+                lastError = e.what();
+                status = -1;
+            }
+            catch (...)
+            {
+                lastError = "unknown error";
+                status = -1;
+            }
+        }
+        if (frames.empty())
+            return status;
+
+        // one run for the whole batch when the model has a dynamic batch axis, one run per image otherwise
+        std::vector<std::vector<Detection>> results = detector->detector.detectBatch(frames, conf_threshold,
+                                                                                     iou_threshold);
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            int index = frameIndices[i];
+            counts[index] = copyDetections(results[i],
+                                           detections ? detections + (size_t)index * capacity_per_image : nullptr,
+                                           capacity_per_image);
+        }
+
+        return status;
+    }
+    catch (const std::exception& e)
+    {
+        lastError = e.what();
+        return -1;
+    }
+    catch (...)
+    {
+        lastError = "unknown error";
+        return -1;
+    }
+}
+
+const char* yolo_ort_last_error(void)
+{
+    return lastError.c_str();
+}
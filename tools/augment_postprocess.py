@@ -0,0 +1,179 @@
+"""
+Append the post-processing to a YOLO onnx model, so the session only returns the kept candidates.
+
+The added ops compute the best class score of every anchor, keep the top
+--max-candidates above --conf and optionally run class-agnostic NMS. The model
+then has a single output `filtered_detections` of shape [1, k, 6], one
+(cx, cy, w, h, conf, class id) row per candidate, which YOLODetector decodes
+directly (OutputLayout::Filtered). The class count is stored as the `num_classes`
+metadata entry.
+
+Supports [1, N, 5 + C] (YOLOv5) and [1, 4 + C, N] (YOLOv8/v11) float outputs.
+
+    python augment_postprocess.py --model yolov5s.onnx --output yolov5s_filtered.onnx --conf 0.25 --nms
+"""
+import argparse
+
+import numpy as np
+import onnx
+from onnx import TensorProto, helper, numpy_helper
+
+OUTPUT_NAME = "filtered_detections"
+INT64_MAX = np.iinfo(np.int64).max
+
+
+class GraphBuilder:
+    def __init__(self, graph, opset):
+        self.graph = graph
+        self.opset = opset
+        self.count = 0
+
+    def name(self, hint):
+        self.count += 1
+        return "pp_{}_{}".format(hint, self.count)
+
+    def const(self, value, dtype):
+        name = self.name("const")
+        self.graph.initializer.append(numpy_helper.from_array(np.array(value, dtype=dtype), name))
+        return name
+
+    def op(self, op_type, inputs, num_outputs=1, **attrs):
+        outputs = [self.name(op_type.lower()) for _ in range(num_outputs)]
+        self.graph.node.append(helper.make_node(op_type, inputs, outputs, name=self.name(op_type), **attrs))
+        return outputs[0] if num_outputs == 1 else outputs
+
+    def slice(self, x, start, end, axis):
+        return self.op("Slice", [x, self.const([start], np.int64), self.const([end], np.int64),
+                                 self.const([axis], np.int64)])
+
+    def squeeze(self, x, axis):
+        if self.opset >= 13:
+            return self.op("Squeeze", [x, self.const([axis], np.int64)])
+        return self.op("Squeeze", [x], axes=[axis])
+
+    def unsqueeze(self, x, axis):
+        if self.opset >= 13:
+            return self.op("Unsqueeze", [x, self.const([axis], np.int64)])
+        return self.op("Unsqueeze", [x], axes=[axis])
+
+    def reduce(self, op_type, x, axis, keepdims):
+        # ReduceSum takes its axes as an input from opset 13, the other reductions from opset 18
+        if self.opset >= (13 if op_type == "ReduceSum" else 18):
+            return self.op(op_type, [x, self.const([axis], np.int64)], keepdims=keepdims)
+        return self.op(op_type, [x], axes=[axis], keepdims=keepdims)
+
+
+def output_layout(output):
+    dims = [d.dim_value if d.HasField("dim_value") else -1 for d in output.type.tensor_type.shape.dim]
+    if len(dims) != 3:
+        raise ValueError("expected a [1, N, 5 + C] or [1, 4 + C, N] output, got {}".format(dims))
+    if output.type.tensor_type.elem_type != TensorProto.FLOAT:
+        raise ValueError("only float outputs are supported")
+
+    # same rule as YOLODetector: a dynamic N is always the last axis of the transposed layout
+    transposed = dims[2] == -1 or (dims[1] != -1 and dims[1] < dims[2])
+    return transposed
+
+
+def augment(model, conf, max_candidates, nms, iou):
+    opset = next(o.version for o in model.opset_import if o.domain in ("", "ai.onnx"))
+    if opset < 11:
+        raise ValueError("opset {} is too old, export with opset 11 or newer".format(opset))
+
+    graph = model.graph
+    raw_output = graph.output[0]
+    transposed = output_layout(raw_output)
+    dims = [d.dim_value for d in raw_output.type.tensor_type.shape.dim]
+    num_classes = dims[1] - 4 if transposed else dims[2] - 5
+    if num_classes <= 0:
+        raise ValueError("the class axis of the output must be static, got {}".format(dims))
+    g = GraphBuilder(graph, opset)
+
+    raw = raw_output.name
+    if transposed:
+        raw = g.op("Transpose", [raw], perm=[0, 2, 1])  # [1, N, 4 + C]
+
+    boxes = g.slice(raw, 0, 4, 2)  # [1, N, 4] cx, cy, w, h
+    if transposed:
+        scores = g.slice(raw, 4, INT64_MAX, 2)
+    else:
+        scores = g.op("Mul", [g.slice(raw, 5, INT64_MAX, 2), g.slice(raw, 4, 5, 2)])  # class * objectness
+
+    best_conf = g.reduce("ReduceMax", scores, 2, 0)  # [1, N]
+    best_class = g.op("ArgMax", [scores], axis=2, keepdims=0)  # [1, N]
+
+    # the top k scores, k = min(N, max_candidates)
+    num_anchors = g.slice(g.op("Shape", [best_conf]), 1, 2, 0)
+    if opset >= 12:
+        k = g.op("Min", [num_anchors, g.const([max_candidates], np.int64)])
+    else:
+        # Min has no int64 kernel before opset 12
+        k = g.op("Cast", [g.op("Min", [g.op("Cast", [num_anchors], to=TensorProto.FLOAT),
+                                       g.const([max_candidates], np.float32)])], to=TensorProto.INT64)
+    top_conf, top_index = g.op("TopK", [best_conf, k], num_outputs=2, axis=1, largest=1, sorted=1)
+
+    # the scores are sorted, so the candidates above the threshold are a prefix
+    above = g.op("Cast", [g.op("Greater", [top_conf, g.const([conf], np.float32)])], to=TensorProto.INT64)
+    num_kept = g.reduce("ReduceSum", above, 1, 0)  # [1]
+    zero = g.const([0], np.int64)
+    axis1 = g.const([1], np.int64)
+    top_conf = g.op("Slice", [top_conf, zero, num_kept, axis1])
+    top_index = g.squeeze(g.op("Slice", [top_index, zero, num_kept, axis1]), 0)  # [m]
+
+    kept_boxes = g.op("Gather", [g.squeeze(boxes, 0), top_index], axis=0)  # [m, 4]
+    kept_class = g.op("Gather", [g.squeeze(best_class, 0), top_index], axis=0)  # [m]
+    kept_conf = g.squeeze(top_conf, 0)  # [m]
+
+    if nms:
+        # class agnostic, like the cv::dnn::NMSBoxes call of the C++ decode
+        selected = g.op("NonMaxSuppression",
+                        [g.unsqueeze(kept_boxes, 0),
+                         g.unsqueeze(g.unsqueeze(kept_conf, 0), 0),
+                         g.const([max_candidates], np.int64),
+                         g.const([iou], np.float32),
+                         g.const([conf], np.float32)],
+                        center_point_box=1)  # [s, 3] (batch, class, box)
+        keep = g.squeeze(g.slice(selected, 2, 3, 1), 1)
+        kept_boxes = g.op("Gather", [kept_boxes, keep], axis=0)
+        kept_conf = g.op("Gather", [kept_conf, keep], axis=0)
+        kept_class = g.op("Gather", [kept_class, keep], axis=0)
+
+    rows = g.op("Concat", [kept_boxes,
+                           g.unsqueeze(kept_conf, 1),
+                           g.unsqueeze(g.op("Cast", [kept_class], to=TensorProto.FLOAT), 1)], axis=1)
+    graph.node.append(helper.make_node("Unsqueeze",
+                                       [rows, g.const([0], np.int64)] if opset >= 13 else [rows],
+                                       [OUTPUT_NAME], name=g.name("Unsqueeze"),
+                                       **({} if opset >= 13 else {"axes": [0]})))
+
+    del graph.output[:]
+    graph.output.append(helper.make_tensor_value_info(OUTPUT_NAME, TensorProto.FLOAT, [1, "candidates", 6]))
+
+    # the rows only carry class ids, YOLODetector resolves its class filter against this count
+    for prop in list(model.metadata_props):
+        if prop.key == "num_classes":
+            model.metadata_props.remove(prop)
+    model.metadata_props.add(key="num_classes", value=str(num_classes))
+
+    return model
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Append in-graph filtering, TopK and NMS to a YOLO onnx model.")
+    parser.add_argument("--model", required=True, help="input onnx model")
+    parser.add_argument("--output", required=True, help="augmented onnx model")
+    parser.add_argument("--conf", type=float, default=0.25,
+                        help="lowest confidence kept, detect() thresholds below it have no effect")
+    parser.add_argument("--max-candidates", type=int, default=300, help="candidates kept by the TopK")
+    parser.add_argument("--nms", action="store_true", help="also run class-agnostic NMS in the graph")
+    parser.add_argument("--iou", type=float, default=0.45, help="IOU threshold of the in-graph NMS")
+    args = parser.parse_args()
+
+    model = augment(onnx.load(args.model), args.conf, args.max_candidates, args.nms, args.iou)
+    onnx.checker.check_model(model)
+    onnx.save(model, args.output)
+    print("Saved {} with output {} [1, k, 6]".format(args.output, OUTPUT_NAME))
+
+
+if __name__ == "__main__":
+    main()
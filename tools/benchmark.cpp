@@ -0,0 +1,232 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "cmdline.h"
+#include "utils.h"
+#include "detector.h"
+
+
+/**
+ * @brief Run every session on its own thread and measure the total throughput
+ * 
+ * @param modelPath Path to the onnx model
+ * @param image Input image
+ * @param numSessions Number of sessions
+ * @param iterations Detections per session
+ * @param pinned Pin each session and its caller thread to one NUMA node
+ * @return double Frames per second over all sessions
+ */
+double runSessions(const std::string& modelPath, const cv::Mat& image,
+                   const int& numSessions, const int& iterations, const bool& pinned)
+{
+    int numNodes = utils::getNumaNodeCount();
+    int sessionsPerNode = (numSessions + numNodes - 1) / numNodes;
+
+    std::vector<YOLODetector> detectors;
+    std::vector<std::vector<int>> sessionCpus;
+    for (int i = 0; i < numSessions; i++)
+    {
+        std::vector<int> nodeCpus = utils::getNumaNodeCpus(i % numNodes);
+        int threads = std::max(1, (int)nodeCpus.size() / sessionsPerNode);
+
+        // both runs use the same thread counts, only the pinning differs
+        DetectorOptions options;
+        options.placement.intraOpThreads = threads;
+        if (pinned)
+        {
+            options.placement.numaNode = i % numNodes;
+            options.placement.preprocessThreads = threads;
+        }
+
+        detectors.emplace_back(modelPath, false, cv::Size(640, 640), options);
+        sessionCpus.push_back(pinned ? nodeCpus : std::vector<int>());
+    }
+
+    // warm up
+    for (YOLODetector& detector : detectors)
+    {
+        cv::Mat frame = image.clone();
+        detector.detect(frame, 0.3f, 0.4f);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < numSessions; i++)
+    {
+        workers.emplace_back([&, i]() {
+            // the caller thread takes part in the intra-op work, so it is pinned as well
+            if (!sessionCpus[i].empty())
+                utils::setThreadAffinity(sessionCpus[i]);
+
+            cv::Mat frame = image.clone();
+            for (int n = 0; n < iterations; n++)
+                detectors[i].detect(frame, 0.3f, 0.4f);
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return (double)numSessions * iterations / seconds;
+}
+
+/**
+ * @brief Run several models at once, each on its own thread, and measure the total throughput
+ * 
+ * @param modelPaths Paths to the onnx models
+ * @param image Input image
+ * @param iterations Detections per model
+ * @param sharedEnv One Env with global thread pools instead of per-session pools
+ * @return double Frames per second over all models
+ */
+double runModels(const std::vector<std::string>& modelPaths, const cv::Mat& image,
+                 const int& iterations, const bool& sharedEnv)
+{
+    // per-session pools keep ORT's default of one thread per core, as a plain detector would
+    DetectorOptions options;
+    options.useSharedEnv = sharedEnv;
+    options.sharedEnv.intraOpThreads = (int)std::thread::hardware_concurrency();
+
+    std::vector<YOLODetector> detectors;
+    for (const std::string& modelPath : modelPaths)
+        detectors.emplace_back(modelPath, false, cv::Size(640, 640), options);
+
+    // warm up
+    for (YOLODetector& detector : detectors)
+    {
+        cv::Mat frame = image.clone();
+        detector.detect(frame, 0.3f, 0.4f);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < detectors.size(); i++)
+    {
+        workers.emplace_back([&, i]() {
+            cv::Mat frame = image.clone();
+            for (int n = 0; n < iterations; n++)
+                detectors[i].detect(frame, 0.3f, 0.4f);
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return (double)detectors.size() * iterations / seconds;
+}
+
+/**
+ * @brief Run one stream of frames through one detector and measure its throughput
+ * 
+ * @param modelPath Path to the onnx model
+ * @param image Input image
+ * @param iterations Detections
+ * @param async Use detectAsync(), preprocessing the next frame during the model run
+ * @return double Frames per second
+ */
+double runStream(const std::string& modelPath, const cv::Mat& image,
+                 const int& iterations, const bool& async)
+{
+    YOLODetector detector(modelPath, false, cv::Size(640, 640));
+
+    // warm up
+    cv::Mat frame = image.clone();
+    detector.detect(frame, 0.3f, 0.4f);
+
+    std::vector<std::future<std::vector<Detection>>> results;
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        if (async)
+            results.push_back(detector.detectAsync(frame, 0.3f, 0.4f));
+        else
+            detector.detect(frame, 0.3f, 0.4f);
+    }
+    for (std::future<std::vector<Detection>>& result : results)
+        result.get();
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return iterations / seconds;
+}
+
+std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        if (!item.empty())
+            items.push_back(item);
+    }
+
+    return items;
+}
+
+
+int main(int argc, char* argv[])
+{
+    cmdline::parser cmd;
+    cmd.add<std::string>("model_path", 'm', "Path to onnx model.", false, "../models/cardetect.onnx");
+    cmd.add<std::string>("image", 'i', "Image to be detected.", false, "../images/car4.png");
+    cmd.add<int>("sessions", 's', "Number of sessions, 0: one per NUMA node.", false, 0);
+    cmd.add<int>("iterations", 'n', "Detections per session.", false, 50);
+    cmd.add<std::string>("models", '\0', "Comma separated onnx models run together, compares per-session and shared thread pools.", false, "");
+    cmd.parse_check(argc, argv);
+
+    const std::string modelPath = cmd.get<std::string>("model_path");
+    int numSessions = cmd.get<int>("sessions");
+    if (numSessions <= 0)
+        numSessions = utils::getNumaNodeCount();
+    int iterations = cmd.get<int>("iterations");
+
+    cv::Mat image = cv::imread(cmd.get<std::string>("image"));
+    if (image.empty())
+    {
+        std::cerr << "Error: Failed to read image." << std::endl;
+        return -1;
+    }
+
+    std::cout << "NUMA nodes: " << utils::getNumaNodeCount() << ", sessions: " << numSessions << std::endl;
+
+    try
+    {
+        double unpinned = runSessions(modelPath, image, numSessions, iterations, false);
+        double pinned = runSessions(modelPath, image, numSessions, iterations, true);
+
+        std::cout << "Unpinned: " << unpinned << " fps" << std::endl;
+        std::cout << "Pinned: " << pinned << " fps (" << (pinned / unpinned - 1.0) * 100.0 << "%)" << std::endl;
+
+        double sync = runStream(modelPath, image, iterations, false);
+        double async = runStream(modelPath, image, iterations, true);
+
+        std::cout << "Single stream, detect: " << sync << " fps" << std::endl;
+        std::cout << "Single stream, detectAsync: " << async << " fps ("
+                  << (async / sync - 1.0) * 100.0 << "%)" << std::endl;
+
+        std::vector<std::string> modelPaths = splitList(cmd.get<std::string>("models"));
+        if (!modelPaths.empty())
+        {
+            double perSession = runModels(modelPaths, image, iterations, false);
+            double shared = runModels(modelPaths, image, iterations, true);
+
+            std::cout << modelPaths.size() << " models, per-session pools: " << perSession << " fps" << std::endl;
+            std::cout << modelPaths.size() << " models, shared Env: " << shared << " fps ("
+                      << (shared / perSession - 1.0) * 100.0 << "%)" << std::endl;
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <opencv2/opencv.hpp>
+#include "cmdline.h"
+#include "utils.h"
+#include "detector.h"
+#include "evaluation.h"
+
+
+/**
+ * @brief One detector configuration of the accuracy vs speed comparison
+ */
+struct EvalConfig
+{
+    std::string name;
+    DetectorOptions options;
+    std::function<void(YOLODetector&)> setup;
+    std::function<std::vector<Detection>(YOLODetector&, cv::Mat&, float, float)> run;
+};
+
+struct EvalResult
+{
+    std::string model;
+    std::string config;
+    double map50{};
+    double map50to95{};
+    double fps{};
+    double meanMs{};
+    double p50Ms{};
+    double p99Ms{};
+};
+
+/**
+ * @brief Configurations selectable with --configs, one per fast path
+ */
+std::vector<EvalConfig> availableConfigs()
+{
+    auto detect = [](YOLODetector& detector, cv::Mat& image, float conf, float iou) {
+        return detector.detect(image, conf, iou);
+    };
+    auto noSetup = [](YOLODetector&) {};
+
+    std::vector<EvalConfig> configs;
+    configs.push_back({"baseline", DetectorOptions(), noSetup, detect});
+    configs.push_back({"topk100", DetectorOptions(), noSetup,
+                       [](YOLODetector& detector, cv::Mat& image, float conf, float iou) {
+                           return detector.detectTopK(image, 100, conf, iou);
+                       }});
+    configs.push_back({"top1", DetectorOptions(), noSetup,
+                       [](YOLODetector& detector, cv::Mat& image, float conf, float iou) {
+                           return detector.detectTopK(image, 1, conf, iou);
+                       }});
+    configs.push_back({"parallel_preprocess", DetectorOptions(),
+                       [](YOLODetector& detector) { detector.setPreprocessThreads(0); }, detect});
+    configs.push_back({"parallel_decode", DetectorOptions(),
+                       [](YOLODetector& detector) { detector.setDecodeThreads(0); }, detect});
+
+    DetectorOptions lowMemory;
+    lowMemory.memory = MemoryOptions::lowMemory();
+    configs.push_back({"low_memory", lowMemory, noSetup, detect});
+
+    return configs;
+}
+
+/**
+ * @brief Run one model and configuration over the dataset
+ */
+EvalResult evaluate(const std::string& modelPath, const EvalConfig& config,
+                    const std::vector<EvalSample>& samples, const cv::Size& inputSize,
+                    const float& confThreshold, const float& iouThreshold)
+{
+    YOLODetector detector(modelPath, false, inputSize, config.options);
+    config.setup(detector);
+
+    evaluation::MeanAP meanAP;
+    std::vector<double> latencies;
+    for (const EvalSample& sample : samples)
+    {
+        cv::Mat image = cv::imread(sample.imagePath);
+        if (image.empty())
+        {
+            std::cerr << "Skipping unreadable image: " << sample.imagePath << std::endl;
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Detection> detections = config.run(detector, image, confThreshold, iouThreshold);
+        auto end = std::chrono::steady_clock::now();
+        latencies.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+
+        meanAP.add(detections, evaluation::toPixels(sample, image.size()));
+    }
+
+    EvalResult result;
+    result.model = modelPath;
+    result.config = config.name;
+    result.map50 = meanAP.map50();
+    result.map50to95 = meanAP.map50to95();
+    if (!latencies.empty())
+    {
+        double total = 0.0;
+        for (double latency : latencies)
+            total += latency;
+        std::sort(latencies.begin(), latencies.end());
+
+        result.meanMs = total / (double)latencies.size();
+        result.fps = 1000.0 / result.meanMs;
+        result.p50Ms = latencies[latencies.size() / 2];
+        result.p99Ms = latencies[std::min(latencies.size() - 1, (size_t)(0.99 * (double)latencies.size()))];
+    }
+
+    return result;
+}
+
+std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        if (!item.empty())
+            items.push_back(item);
+    }
+
+    return items;
+}
+
+
+int main(int argc, char* argv[])
+{
+    cmdline::parser cmd;
+    cmd.add<std::string>("models", 'm', "Comma separated onnx models, e.g. fp32 and quantized.", false, "../models/cardetect.onnx");
+    cmd.add<std::string>("images", 'i', "Directory of the dataset images.", true);
+    cmd.add<std::string>("labels", 'l', "Directory of YOLO txt labels.", false, "");
+    cmd.add<std::string>("coco", '\0', "COCO JSON annotation file, instead of --labels.", false, "");
+    cmd.add<std::string>("configs", 'c', "Comma separated configurations: baseline, topk100, top1, parallel_preprocess, parallel_decode, low_memory.", false, "baseline");
+    cmd.add<int>("size", 's', "Input size of the model.", false, 640);
+    cmd.add<float>("conf", '\0', "Confidence threshold.", false, 0.001f);
+    cmd.add<float>("iou", '\0', "IOU threshold.", false, 0.6f);
+    cmd.add<std::string>("csv", '\0', "Write the results as CSV for plotting.", false, "");
+    cmd.parse_check(argc, argv);
+
+    std::vector<EvalSample> samples;
+    try
+    {
+        if (!cmd.get<std::string>("coco").empty())
+            samples = evaluation::loadCocoDataset(cmd.get<std::string>("coco"), cmd.get<std::string>("images"));
+        else
+            samples = evaluation::loadYoloDataset(cmd.get<std::string>("images"), cmd.get<std::string>("labels"));
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+    if (samples.empty())
+    {
+        std::cerr << "Error: Empty dataset." << std::endl;
+        return -1;
+    }
+    std::cout << "Images: " << samples.size() << std::endl;
+
+    std::vector<EvalConfig> configs = availableConfigs();
+    std::vector<EvalResult> results;
+    int size = cmd.get<int>("size");
+    for (const std::string& model : splitList(cmd.get<std::string>("models")))
+    {
+        for (const std::string& name : splitList(cmd.get<std::string>("configs")))
+        {
+            auto config = std::find_if(configs.begin(), configs.end(),
+                                       [&name](const EvalConfig& c) { return c.name == name; });
+            if (config == configs.end())
+            {
+                std::cerr << "Unknown configuration: " << name << std::endl;
+                return -1;
+            }
+
+            try
+            {
+                results.push_back(evaluate(model, *config, samples, cv::Size(size, size),
+                                           cmd.get<float>("conf"), cmd.get<float>("iou")));
+            }
+            catch(const std::exception& e)
+            {
+                std::cerr << e.what() << std::endl;
+                return -1;
+            }
+        }
+    }
+
+    std::cout << "model,config,mAP@0.5,mAP@0.5:0.95,fps,mean_ms,p50_ms,p99_ms" << std::endl;
+    std::ofstream csv;
+    if (!cmd.get<std::string>("csv").empty())
+    {
+        csv.open(cmd.get<std::string>("csv"));
+        csv << "model,config,map50,map50_95,fps,mean_ms,p50_ms,p99_ms" << std::endl;
+    }
+    for (const EvalResult& result : results)
+    {
+        std::ostringstream line;
+        line << result.model << "," << result.config << ","
+             << result.map50 << "," << result.map50to95 << ","
+             << result.fps << "," << result.meanMs << "," << result.p50Ms << "," << result.p99Ms;
+        std::cout << line.str() << std::endl;
+        if (csv.is_open())
+            csv << line.str() << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,468 @@
+#include "evaluation.h"
+
+#include <cctype>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+/**
+ * @brief Minimal JSON reader, only what COCO annotation files need
+ */
+struct JsonValue
+{
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type{Type::Null};
+    double number{};
+    std::string string;
+    std::vector<JsonValue> array;
+    std::map<std::string, JsonValue> object;
+
+    const JsonValue& operator[](const std::string& key) const
+    {
+        static const JsonValue null;
+        auto it = object.find(key);
+        return it == object.end() ? null : it->second;
+    }
+};
+
+class JsonParser
+{
+public:
+    explicit JsonParser(const std::string& text) : text(text) {}
+
+    JsonValue parse()
+    {
+        JsonValue value = parseValue();
+        skipSpaces();
+        if (pos != text.size())
+            fail("trailing characters");
+        return value;
+    }
+
+private:
+    const std::string& text;
+    size_t pos{0};
+
+    void fail(const std::string& message) const
+    {
+        throw std::runtime_error("JSON parse error at " + std::to_string(pos) + ": " + message);
+    }
+
+    void skipSpaces()
+    {
+        while (pos < text.size() && std::isspace((unsigned char)text[pos]))
+            pos++;
+    }
+
+    bool consume(char c)
+    {
+        skipSpaces();
+        if (pos < text.size() && text[pos] == c)
+        {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c)
+    {
+        if (!consume(c))
+            fail(std::string("expected '") + c + "'");
+    }
+
+    JsonValue parseValue()
+    {
+        skipSpaces();
+        if (pos >= text.size())
+            fail("unexpected end");
+
+        JsonValue value;
+        char c = text[pos];
+        if (c == '{')
+        {
+            value.type = JsonValue::Type::Object;
+            pos++;
+            if (consume('}'))
+                return value;
+            do
+            {
+                skipSpaces();
+                std::string key = parseString();
+                expect(':');
+                value.object[key] = parseValue();
+            } while (consume(','));
+            expect('}');
+        }
+        else if (c == '[')
+        {
+            value.type = JsonValue::Type::Array;
+            pos++;
+            if (consume(']'))
+                return value;
+            do
+            {
+                value.array.push_back(parseValue());
+            } while (consume(','));
+            expect(']');
+        }
+        else if (c == '"')
+        {
+            value.type = JsonValue::Type::String;
+            value.string = parseString();
+        }
+        else if (text.compare(pos, 4, "true") == 0 || text.compare(pos, 5, "false") == 0)
+        {
+            value.type = JsonValue::Type::Bool;
+            value.number = text[pos] == 't' ? 1.0 : 0.0;
+            pos += text[pos] == 't' ? 4 : 5;
+        }
+        else if (text.compare(pos, 4, "null") == 0)
+        {
+            pos += 4;
+        }
+        else
+        {
+            size_t end = pos;
+            while (end < text.size() && (std::isdigit((unsigned char)text[end]) || text[end] == '-' ||
+                                         text[end] == '+' || text[end] == '.' || text[end] == 'e' || text[end] == 'E'))
+                end++;
+            if (end == pos)
+                fail("unexpected character");
+            value.type = JsonValue::Type::Number;
+            value.number = std::stod(text.substr(pos, end - pos));
+            pos = end;
+        }
+
+        return value;
+    }
+
+    std::string parseString()
+    {
+        if (pos >= text.size() || text[pos] != '"')
+            fail("expected string");
+        pos++;
+
+        std::string result;
+        while (pos < text.size() && text[pos] != '"')
+        {
+            if (text[pos] == '\\' && pos + 1 < text.size())
+            {
+                pos++;
+                switch (text[pos])
+                {
+                case 'n': result += '\n'; break;
+                case 't': result += '\t'; break;
+                case 'r': result += '\r'; break;
+                case 'b': result += '\b'; break;
+                case 'f': result += '\f'; break;
+                case 'u': result += '?'; pos += 4; break; // file names only, non-ASCII is not needed
+                default: result += text[pos]; break;
+                }
+                pos++;
+            }
+            else
+            {
+                result += text[pos++];
+            }
+        }
+        if (pos >= text.size())
+            fail("unterminated string");
+        pos++;
+
+        return result;
+    }
+};
+
+/**
+ * @brief Load a dataset in YOLO txt format
+ * 
+ * Every image of imagesDir has a labelsDir/<name>.txt with one "class cx cy w h"
+ * line per object, normalized to [0, 1]. Images without a label file have no objects.
+ * 
+ * @param imagesDir Directory of the images
+ * @param labelsDir Directory of the label files
+ * @return std::vector<EvalSample> 
+ */
+std::vector<EvalSample> evaluation::loadYoloDataset(const std::string& imagesDir, const std::string& labelsDir)
+{
+    std::vector<EvalSample> samples;
+
+    std::vector<cv::String> imagePaths;
+    cv::glob(imagesDir + "/*", imagePaths, false);
+    for (const std::string& imagePath : imagePaths)
+    {
+        size_t slash = imagePath.find_last_of("/\\");
+        size_t dot = imagePath.find_last_of('.');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            continue;
+
+        std::string extension = imagePath.substr(dot + 1);
+        for (char& c : extension)
+            c = (char)std::tolower((unsigned char)c);
+        if (extension != "jpg" && extension != "jpeg" && extension != "png" &&
+            extension != "bmp" && extension != "webp")
+            continue;
+
+        EvalSample sample;
+        sample.imagePath = imagePath;
+        sample.normalized = true;
+
+        std::string stem = imagePath.substr(slash == std::string::npos ? 0 : slash + 1,
+                                            dot - (slash == std::string::npos ? 0 : slash + 1));
+        std::ifstream labelFile(labelsDir + "/" + stem + ".txt");
+        std::string line;
+        while (std::getline(labelFile, line))
+        {
+            std::istringstream stream(line);
+            GroundTruth label;
+            float cx, cy, w, h;
+            if (stream >> label.classId >> cx >> cy >> w >> h)
+            {
+                label.box = cv::Rect2f(cx, cy, w, h);
+                sample.labels.push_back(label);
+            }
+        }
+
+        samples.push_back(sample);
+    }
+
+    return samples;
+}
+
+/**
+ * @brief Load a dataset in COCO JSON format
+ * 
+ * Categories are mapped to class ids in the order of their COCO ids, which gives
+ * the usual 80 class ids of coco.names for the COCO dataset. Crowd annotations are skipped.
+ * 
+ * @param jsonPath Path to the annotation file
+ * @param imagesDir Directory of the images
+ * @return std::vector<EvalSample> 
+ */
+std::vector<EvalSample> evaluation::loadCocoDataset(const std::string& jsonPath, const std::string& imagesDir)
+{
+    std::ifstream file(jsonPath);
+    if (!file.good())
+        throw std::runtime_error("Failed to access COCO annotation file: " + jsonPath);
+
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text = buffer.str();
+    JsonValue root = JsonParser(text).parse();
+
+    std::map<int, int> categoryToClass;
+    for (const JsonValue& category : root["categories"].array)
+        categoryToClass[(int)category["id"].number] = 0;
+    int classId = 0;
+    for (auto& item : categoryToClass)
+        item.second = classId++;
+
+    std::vector<EvalSample> samples;
+    std::map<int, size_t> imageIndex;
+    for (const JsonValue& image : root["images"].array)
+    {
+        imageIndex[(int)image["id"].number] = samples.size();
+        EvalSample sample;
+        sample.imagePath = imagesDir + "/" + image["file_name"].string;
+        samples.push_back(sample);
+    }
+
+    for (const JsonValue& annotation : root["annotations"].array)
+    {
+        if (annotation["iscrowd"].number != 0.0)
+            continue;
+
+        auto image = imageIndex.find((int)annotation["image_id"].number);
+        auto category = categoryToClass.find((int)annotation["category_id"].number);
+        const std::vector<JsonValue>& bbox = annotation["bbox"].array;
+        if (image == imageIndex.end() || category == categoryToClass.end() || bbox.size() != 4)
+            continue;
+
+        GroundTruth label;
+        label.classId = category->second;
+        label.box = cv::Rect2f((float)bbox[0].number, (float)bbox[1].number,
+                               (float)bbox[2].number, (float)bbox[3].number);
+        samples[image->second].labels.push_back(label);
+    }
+
+    return samples;
+}
+
+/**
+ * @brief Get the labels of a sample in pixels
+ * 
+ * @param sample Sample
+ * @param imageShape Shape of the sample image
+ * @return std::vector<GroundTruth> Labels with (x, y, w, h) boxes in pixels
+ */
+std::vector<GroundTruth> evaluation::toPixels(const EvalSample& sample, const cv::Size& imageShape)
+{
+    if (!sample.normalized)
+        return sample.labels;
+
+    std::vector<GroundTruth> labels = sample.labels;
+    for (GroundTruth& label : labels)
+    {
+        float w = label.box.width * (float)imageShape.width;
+        float h = label.box.height * (float)imageShape.height;
+        label.box = cv::Rect2f(label.box.x * (float)imageShape.width - w / 2.0f,
+                               label.box.y * (float)imageShape.height - h / 2.0f, w, h);
+    }
+
+    return labels;
+}
+
+/**
+ * @brief Intersection over union of two float boxes
+ */
+static float boxIoU(const cv::Rect2f& a, const cv::Rect2f& b)
+{
+    float interWidth = std::min(a.x + a.width, b.x + b.width) - std::max(a.x, b.x);
+    float interHeight = std::min(a.y + a.height, b.y + b.height) - std::max(a.y, b.y);
+    if (interWidth <= 0.0f || interHeight <= 0.0f)
+        return 0.0f;
+
+    float interArea = interWidth * interHeight;
+    return interArea / (a.width * a.height + b.width * b.height - interArea);
+}
+
+evaluation::MeanAP::MeanAP()
+{
+    for (int i = 0; i < 10; i++)
+        iouThresholds.push_back(0.5f + 0.05f * (float)i);
+    records.resize(iouThresholds.size());
+}
+
+/**
+ * @brief Match the detections of one image to its labels
+ * 
+ * @param detections Detections in pixels
+ * @param labels Labels in pixels
+ */
+void evaluation::MeanAP::add(const std::vector<Detection>& detections, const std::vector<GroundTruth>& labels)
+{
+    for (const GroundTruth& label : labels)
+        numLabels[label.classId]++;
+
+    std::vector<size_t> order(detections.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&detections](size_t a, size_t b) {
+        return detections[a].conf > detections[b].conf;
+    });
+
+    for (size_t t = 0; t < iouThresholds.size(); t++)
+    {
+        std::vector<bool> matched(labels.size(), false);
+        for (size_t i : order)
+        {
+            const Detection& detection = detections[i];
+            cv::Rect2f box((float)detection.box.x, (float)detection.box.y,
+                           (float)detection.box.width, (float)detection.box.height);
+
+            int bestLabel = -1;
+            float bestIoU = iouThresholds[t];
+            for (size_t j = 0; j < labels.size(); j++)
+            {
+                if (matched[j] || labels[j].classId != detection.classId)
+                    continue;
+
+                float iou = boxIoU(box, labels[j].box);
+                if (iou >= bestIoU)
+                {
+                    bestIoU = iou;
+                    bestLabel = (int)j;
+                }
+            }
+
+            if (bestLabel >= 0)
+                matched[bestLabel] = true;
+            records[t][detection.classId].emplace_back(detection.conf, bestLabel >= 0);
+        }
+    }
+}
+
+/**
+ * @brief COCO 101-point interpolated average precision of one class
+ * 
+ * @param records (confidence, true positive) of the detections of the class
+ * @param numLabels Number of labels of the class
+ * @return double AP
+ */
+double evaluation::MeanAP::averagePrecision(std::vector<std::pair<float, bool>> records, const int& numLabels)
+{
+    if (numLabels == 0)
+        return 0.0;
+
+    std::stable_sort(records.begin(), records.end(),
+                     [](const std::pair<float, bool>& a, const std::pair<float, bool>& b) {
+                         return a.first > b.first;
+                     });
+
+    std::vector<double> precision, recall;
+    int truePositives = 0;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        truePositives += records[i].second ? 1 : 0;
+        precision.push_back((double)truePositives / (double)(i + 1));
+        recall.push_back((double)truePositives / (double)numLabels);
+    }
+
+    // precision envelope
+    for (int i = (int)precision.size() - 2; i >= 0; i--)
+        precision[i] = std::max(precision[i], precision[i + 1]);
+
+    double sum = 0.0;
+    size_t index = 0;
+    for (int point = 0; point <= 100; point++)
+    {
+        double r = point / 100.0;
+        while (index < recall.size() && recall[index] < r)
+            index++;
+        if (index < precision.size())
+            sum += precision[index];
+    }
+
+    return sum / 101.0;
+}
+
+/**
+ * @brief Mean AP over the classes with labels at one IoU threshold
+ * 
+ * @param thresholdIndex Index of the IoU threshold, 0 is 0.5
+ * @return double mAP
+ */
+double evaluation::MeanAP::map(const size_t& thresholdIndex) const
+{
+    if (numLabels.empty())
+        return 0.0;
+
+    static const std::vector<std::pair<float, bool>> empty;
+
+    double sum = 0.0;
+    for (const auto& item : numLabels)
+    {
+        auto classRecords = records[thresholdIndex].find(item.first);
+        sum += averagePrecision(classRecords == records[thresholdIndex].end() ? empty : classRecords->second,
+                                item.second);
+    }
+
+    return sum / (double)numLabels.size();
+}
+
+/**
+ * @brief Mean of the mAP over the IoU thresholds 0.5, 0.55, ..., 0.95
+ * 
+ * @return double mAP@0.5:0.95
+ */
+double evaluation::MeanAP::map50to95() const
+{
+    double sum = 0.0;
+    for (size_t t = 0; t < iouThresholds.size(); t++)
+        sum += this->map(t);
+
+    return sum / (double)iouThresholds.size();
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "utils.h"
+
+
+struct GroundTruth
+{
+    cv::Rect2f box;  // pixels, or (cx, cy, w, h) normalized to [0, 1] for YOLO txt labels
+    int classId{};
+};
+
+struct EvalSample
+{
+    std::string imagePath;
+    std::vector<GroundTruth> labels;
+    bool normalized{};  // labels are normalized YOLO txt boxes, see toPixels()
+};
+
+namespace evaluation
+{
+    std::vector<EvalSample> loadYoloDataset(const std::string& imagesDir, const std::string& labelsDir);
+    std::vector<EvalSample> loadCocoDataset(const std::string& jsonPath, const std::string& imagesDir);
+    std::vector<GroundTruth> toPixels(const EvalSample& sample, const cv::Size& imageShape);
+
+    /**
+     * @brief Accumulates detections and labels of a dataset into mAP@0.5 and mAP@0.5:0.95
+     * 
+     * Detections are matched greedily by confidence to the unmatched label of the same
+     * class with the highest IoU, AP uses COCO's 101-point interpolation.
+     */
+    class MeanAP
+    {
+    public:
+        MeanAP();
+
+        void add(const std::vector<Detection>& detections, const std::vector<GroundTruth>& labels);
+
+        double map50() const { return this->map(0); }
+        double map50to95() const;
+
+    private:
+        // (confidence, true positive) of every detection, per IoU threshold and class
+        std::vector<std::map<int, std::vector<std::pair<float, bool>>>> records;
+        std::map<int, int> numLabels;
+        std::vector<float> iouThresholds;
+
+        double map(const size_t& thresholdIndex) const;
+        static double averagePrecision(std::vector<std::pair<float, bool>> records, const int& numLabels);
+    };
+}
@@ -0,0 +1,346 @@
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <opencv2/opencv.hpp>
+#include "cmdline.h"
+#include "utils.h"
+#include "detector.h"
+
+
+/**
+ * @brief Memory and latency of one sampling window
+ */
+struct SoakSample
+{
+    double minutes{};        // since the start of the run
+    size_t rssBytes{};
+    size_t bufferBytes{};    // input buffers kept by the detector, see MemoryStats
+    size_t frames{};         // detected in the window
+    double p50Ms{};
+    double p99Ms{};
+};
+
+struct SoakLimits
+{
+    double warmupMinutes{5.0};    // samples before this are not checked, arenas and caches still grow
+    double maxRssGrowthMb{64.0};  // RSS above the first checked sample
+    int maxGrowingSamples{12};    // consecutive samples with a higher RSS than the previous one
+    double maxLatencyDrift{0.25}; // p99 above the first checked samples, as a fraction
+};
+
+/**
+ * @brief One step of a soak mode, detects frames and appends their latencies
+ */
+using SoakStep = std::function<void(std::vector<double>& latencies)>;
+
+double percentile(std::vector<double> values, const double& fraction)
+{
+    if (values.empty())
+        return 0.0;
+
+    size_t index = std::min(values.size() - 1, (size_t)(fraction * (double)values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+double median(std::vector<double> values)
+{
+    return percentile(values, 0.5);
+}
+
+/**
+ * @brief Check the samples taken so far against the limits
+ * 
+ * RSS fails on growth beyond the limit or on a long run of strictly growing
+ * samples, a leak grows slowly but never shrinks. Latency compares the median
+ * p99 of the last three windows with that of the first three checked ones, so
+ * a single slow window does not fail the run.
+ * 
+ * @param samples Samples in the order they were taken
+ * @param limits Limits of the run
+ * @return std::string Reason of the failure, empty while the run is healthy
+ */
+std::string checkSamples(const std::vector<SoakSample>& samples, const SoakLimits& limits)
+{
+    auto first = std::find_if(samples.begin(), samples.end(), [&limits](const SoakSample& sample) {
+        return sample.minutes >= limits.warmupMinutes;
+    });
+    if (first == samples.end())
+        return "";
+
+    const SoakSample& baseline = *first;
+    const SoakSample& last = samples.back();
+    double growthMb = ((double)last.rssBytes - (double)baseline.rssBytes) / (1024.0 * 1024.0);
+    if (growthMb > limits.maxRssGrowthMb)
+    {
+        std::ostringstream reason;
+        reason << "RSS grew by " << growthMb << " MB since minute " << baseline.minutes;
+        return reason.str();
+    }
+
+    int growing = 0;
+    for (auto it = first + 1; it != samples.end(); ++it)
+        growing = it->rssBytes > (it - 1)->rssBytes ? growing + 1 : 0;
+    if (growing >= limits.maxGrowingSamples)
+    {
+        std::ostringstream reason;
+        reason << "RSS grew in each of the last " << growing << " samples";
+        return reason.str();
+    }
+
+    size_t checked = (size_t)(samples.end() - first);
+    if (checked >= 6)
+    {
+        std::vector<double> head, tail;
+        for (size_t i = 0; i < 3; i++)
+        {
+            head.push_back((first + i)->p99Ms);
+            tail.push_back((samples.end() - 1 - i)->p99Ms);
+        }
+
+        double baselineP99 = median(head);
+        double currentP99 = median(tail);
+        if (baselineP99 > 0.0 && currentP99 > baselineP99 * (1.0 + limits.maxLatencyDrift))
+        {
+            std::ostringstream reason;
+            reason << "p99 latency drifted from " << baselineP99 << " ms to " << currentP99 << " ms";
+            return reason.str();
+        }
+    }
+
+    return "";
+}
+
+/**
+ * @brief Build the step of a mode, cycling through the images
+ * 
+ * @param mode detect, topk, batch or async
+ * @param detector Detector under test
+ * @param images Decoded sample images
+ * @param batchSize Images per detectBatch call
+ * @return SoakStep
+ */
+SoakStep makeStep(const std::string& mode, YOLODetector& detector,
+                  std::vector<cv::Mat>& images, const int& batchSize)
+{
+    YOLODetector* target = &detector;
+    std::vector<cv::Mat>* source = &images;
+    auto next = std::make_shared<size_t>(0);
+    auto nextImage = [source, next]() -> cv::Mat& { return (*source)[(*next)++ % source->size()]; };
+    auto timed = [](const std::function<void()>& run) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    };
+
+    if (mode == "detect")
+    {
+        return [target, nextImage, timed](std::vector<double>& latencies) {
+            cv::Mat& image = nextImage();
+            latencies.push_back(timed([&]() { target->detect(image, 0.25f, 0.45f); }));
+        };
+    }
+    if (mode == "topk")
+    {
+        return [target, nextImage, timed](std::vector<double>& latencies) {
+            cv::Mat& image = nextImage();
+            latencies.push_back(timed([&]() { target->detectTopK(image, 1, 0.25f, 0.45f); }));
+        };
+    }
+    if (mode == "batch")
+    {
+        return [target, nextImage, timed, batchSize](std::vector<double>& latencies) {
+            std::vector<cv::Mat> batch;
+            for (int i = 0; i < batchSize; i++)
+                batch.push_back(nextImage());
+            latencies.push_back(timed([&]() { target->detectBatch(batch, 0.25f, 0.45f); }));
+        };
+    }
+    if (mode == "async")
+    {
+        // latencies are appended on the inference thread, a failed frame fails the next step
+        auto mutex = std::make_shared<std::mutex>();
+        auto failure = std::make_shared<std::exception_ptr>();
+        return [target, nextImage, mutex, failure](std::vector<double>& latencies) {
+            {
+                std::lock_guard<std::mutex> lock(*mutex);
+                if (*failure)
+                    std::rethrow_exception(*failure);
+            }
+
+            auto submitted = std::chrono::steady_clock::now();
+            target->detectAsync(nextImage(), 0.25f, 0.45f,
+                                [&latencies, mutex, failure, submitted](std::vector<Detection>,
+                                                                        std::exception_ptr error) {
+                                    auto end = std::chrono::steady_clock::now();
+                                    std::lock_guard<std::mutex> lock(*mutex);
+                                    if (error)
+                                        *failure = error;
+                                    else
+                                        latencies.push_back(std::chrono::duration<double, std::milli>(
+                                                end - submitted).count());
+                                });
+        };
+    }
+
+    throw std::runtime_error("Unknown mode: " + mode);
+}
+
+/**
+ * @brief Run one mode for the given duration, sampling memory and latency
+ * 
+ * @param mode Mode of makeStep()
+ * @param modelPath Path to the onnx model
+ * @param images Decoded sample images
+ * @param minutes Duration of the run
+ * @param intervalSeconds Length of a sampling window
+ * @param limits Limits of the run
+ * @param csv Receives one line per sample, if open
+ * @return bool The run stayed within the limits
+ */
+bool runSoak(const std::string& mode, const std::string& modelPath, std::vector<cv::Mat>& images,
+             const double& minutes, const double& intervalSeconds, const SoakLimits& limits,
+             std::ofstream& csv)
+{
+    // declared before the detector, async frames still in flight append to it until the detector is gone
+    std::vector<double> latencies;
+    std::vector<SoakSample> samples;
+
+    YOLODetector detector(modelPath, false, cv::Size(640, 640));
+    int batchSize = detector.supportsBatch() ? 4 : 1;
+    SoakStep step = makeStep(mode, detector, images, batchSize);
+
+    auto start = std::chrono::steady_clock::now();
+    auto windowStart = start;
+    size_t frames = 0;
+    while (true)
+    {
+        step(latencies);
+        frames += mode == "batch" ? batchSize : 1;
+
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - windowStart).count() < intervalSeconds)
+            continue;
+
+        detector.waitAsync();
+        SoakSample sample;
+        sample.minutes = std::chrono::duration<double>(now - start).count() / 60.0;
+        size_t peakRssBytes;
+        utils::getMemoryUsage(sample.rssBytes, peakRssBytes);
+        sample.bufferBytes = detector.memoryStats().inputBufferBytes;
+        sample.frames = frames;
+        sample.p50Ms = percentile(latencies, 0.5);
+        sample.p99Ms = percentile(latencies, 0.99);
+        samples.push_back(sample);
+
+        std::ostringstream line;
+        line << mode << "," << sample.minutes << "," << sample.rssBytes / (1024 * 1024) << ","
+             << sample.bufferBytes / (1024 * 1024) << "," << sample.frames << ","
+             << sample.p50Ms << "," << sample.p99Ms;
+        std::cout << line.str() << std::endl;
+        if (csv.is_open())
+            csv << line.str() << std::endl;
+
+        std::string failure = checkSamples(samples, limits);
+        if (!failure.empty())
+        {
+            std::cerr << "FAIL " << mode << ": " << failure << std::endl;
+            return false;
+        }
+        if (sample.minutes >= minutes)
+            break;
+
+        latencies.clear();
+        frames = 0;
+        windowStart = std::chrono::steady_clock::now();
+    }
+
+    std::cout << "PASS " << mode << ": " << samples.size() << " samples" << std::endl;
+    return true;
+}
+
+std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+    {
+        if (!item.empty())
+            items.push_back(item);
+    }
+
+    return items;
+}
+
+
+int main(int argc, char* argv[])
+{
+    cmdline::parser cmd;
+    cmd.add<std::string>("model_path", 'm', "Path to onnx model.", false, "../models/cardetect.onnx");
+    cmd.add<std::string>("images", 'i', "Directory of the sample images, detected in a loop.", false, "../images");
+    cmd.add<std::string>("modes", '\0', "Comma separated modes run one after the other: detect, topk, batch, async.", false, "detect,batch,async");
+    cmd.add<double>("minutes", '\0', "Duration of each mode.", false, 120.0);
+    cmd.add<double>("interval", '\0', "Seconds between two samples.", false, 60.0);
+    cmd.add<double>("warmup", '\0', "Minutes before the samples are checked.", false, 5.0);
+    cmd.add<double>("max_rss_growth", '\0', "MB of RSS growth after the warm-up that fail the run.", false, 64.0);
+    cmd.add<int>("max_growing", '\0', "Consecutive samples with growing RSS that fail the run.", false, 12);
+    cmd.add<double>("max_drift", '\0', "Fraction of p99 latency drift that fails the run.", false, 0.25);
+    cmd.add<std::string>("csv", '\0', "Write the samples as CSV for plotting.", false, "");
+    cmd.parse_check(argc, argv);
+
+    std::vector<cv::Mat> images;
+    std::vector<cv::String> imagePaths;
+    cv::glob(cmd.get<std::string>("images") + "/*", imagePaths, false);
+    for (const std::string& imagePath : imagePaths)
+    {
+        cv::Mat image = cv::imread(imagePath);
+        if (!image.empty())
+            images.push_back(image);
+    }
+    if (images.empty())
+    {
+        std::cerr << "Error: No readable images." << std::endl;
+        return -1;
+    }
+    std::cout << "Images: " << images.size() << std::endl;
+
+    SoakLimits limits;
+    limits.warmupMinutes = cmd.get<double>("warmup");
+    limits.maxRssGrowthMb = cmd.get<double>("max_rss_growth");
+    limits.maxGrowingSamples = cmd.get<int>("max_growing");
+    limits.maxLatencyDrift = cmd.get<double>("max_drift");
+
+    std::ofstream csv;
+    if (!cmd.get<std::string>("csv").empty())
+    {
+        csv.open(cmd.get<std::string>("csv"));
+        csv << "mode,minutes,rss_mb,buffers_mb,frames,p50_ms,p99_ms" << std::endl;
+    }
+    std::cout << "mode,minutes,rss_mb,buffers_mb,frames,p50_ms,p99_ms" << std::endl;
+
+    bool passed = true;
+    for (const std::string& mode : splitList(cmd.get<std::string>("modes")))
+    {
+        try
+        {
+            passed = runSoak(mode, cmd.get<std::string>("model_path"), images, cmd.get<double>("minutes"),
+                             cmd.get<double>("interval"), limits, csv) && passed;
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+    }
+
+    return passed ? 0 : 1;
+}